@@ -18,6 +18,14 @@
 #include <memory>
 #include <compare>
 #include <complex>
+#include <array>
+#include <utility>
+#include <initializer_list>
+#include <charconv>
+#include <iterator>
+#include <queue>
+#include <thread>
+#include <stdexcept>
 #endif /* __PROGTEST__ */
 using namespace std;
 // keep this dummy version if you do not implement a real manipulator
@@ -26,191 +34,1449 @@ std::ios_base & ( * poly_var ( const std::string & name ) ) ( std::ios_base & x
   return [] ( std::ios_base & ios ) -> std::ios_base & { return ios; };
 }
 
-class CPolynomial
+class CPolynomial;
+
+// Arithmetic on CPolynomial builds lightweight expression objects that are
+// only evaluated when assigned, so a * b * -2 or a + b * 3 is computed
+// straight into the destination without intermediate polynomials.
+// Expressions refer to named operands; a temporary CPolynomial operand is
+// consumed instead and the result is a plain CPolynomial. Reading an
+// expression like a polynomial evaluates it first.
+template <typename TExpr>
+struct CPolyExpr
+{
+  const TExpr& self() const { return static_cast<const TExpr&>(*this); }
+
+  unsigned degree() const;
+  double operator()(double x) const;
+  double operator[](int degree) const;
+  explicit operator bool() const;
+  bool operator!() const;
+};
+
+class CPolynomial : public CPolyExpr<CPolynomial>
 {
   public:
     CPolynomial() = default;
 
     CPolynomial(const CPolynomial& other) = default;
 
+    CPolynomial(CPolynomial&& other) noexcept = default;
+
     ~CPolynomial() = default;
 
     CPolynomial& operator=(const CPolynomial& other) 
     {
       if (this != &other) { 
+        dense = other.dense;
+        values = other.values;
         coefficients = other.coefficients; 
       }
       return *this;
     }
+    CPolynomial& operator=(CPolynomial&& other) noexcept = default;
+
+    template <typename TExpr>
+    CPolynomial(const CPolyExpr<TExpr>& expr)
+    {
+      assign(expr.self());
+    }
+    template <typename TExpr>
+    CPolynomial& operator=(const CPolyExpr<TExpr>& expr)
+    {
+      assign(expr.self());
+      return *this;
+    }
     friend ostream& operator<<(ostream& os, const CPolynomial& poly) {
-      ostringstream ss;
+      poly.format_to(ostreambuf_iterator<char>(os));
+      return os;
+    }
+    // writes the terms from the highest degree down, e.g. "- 2*x^3 + x^1 - 10";
+    // numbers go through to_chars into a stack buffer, nothing is allocated
+    template <typename TOutputIt>
+    TOutputIt format_to(TOutputIt out) const {
+      char buffer[64];
       bool first = true;
-      vector<pair<int, double>> sortedCoeffs = poly.coefficients;
-      sort(sortedCoeffs.begin(), sortedCoeffs.end(), [](const auto& a, const auto& b) {
-        return a.first > b.first;
-      });
+      auto put = [&](const char* text) {
+        while (*text) {
+          *out++ = *text++;
+        }
+      };
+      auto putNumber = [&](auto number, auto... format) {
+        auto result = to_chars(buffer, buffer + sizeof(buffer), number, format...);
+        out = copy(buffer, result.ptr, out);
+      };
 
-      for (const auto& coeff : sortedCoeffs) 
+      forEachTermDescending([&](int deg, double value) 
       {
-        if (coeff.second == 0) continue;
         if (!first) {
-            ss << (coeff.second > 0 ? " + " : " - ");
+            put(value > 0 ? " + " : " - ");
         } else {
-            if (coeff.second < 0) ss << "- ";
+            if (value < 0) put("- ");
             first = false;
         }
-        double absValue = abs(coeff.second);
-        if (absValue != 1 || coeff.first == 0) {
-            ss << absValue;
+        double absValue = abs(value);
+        if (absValue != 1 || deg == 0) {
+            putNumber(absValue, chars_format::general, FORMAT_PRECISION);
+            if (deg > 0) put("*");
         }
-        if(coeff.second == 1 || coeff.second == -1 )
+        if (deg > 0) 
         {
-          ss << "x";
-          if (coeff.first >= 1) 
-          {
-            ss << "^" << coeff.first;
-          }
-        }
-        else if (coeff.first > 0) 
-        {
-          ss << "*x";
-          if (coeff.first >= 1) 
-          {
-            ss << "^" << coeff.first;
-          }
+          put("x^");
+          putNumber(deg);
         }
-      }
+      });
       if (first) {
-        ss << "0";
+        put("0");
       }
-      os << ss.str();
-      return os;
+      return out;
     }
-  CPolynomial operator*(double scalar) const 
-  {
-    CPolynomial result = *this;
-    for (auto& coeff : result.coefficients) {
-        coeff.second *= scalar;
-    }
-    result.removeZeros();
-    return result;
-  }
-  CPolynomial operator*(const CPolynomial& other) const {
-    CPolynomial result;
-    for (const auto& [deg1, coeff1] : coefficients) {
-        for (const auto& [deg2, coeff2] : other.coefficients) {
-            result[deg1 + deg2] += coeff1 * coeff2;
-        }
-    }
-    result.removeZeros();
-    return result;
-  }
   CPolynomial& operator*=(double scalar) {
-    for (auto& coeff : coefficients) {
-        coeff.second *= scalar;
+    if (dense) {
+      for (double& value : values) {
+          value *= scalar;
+      }
+    } else {
+      for (auto& coeff : coefficients) {
+          coeff.second *= scalar;
+      }
     }
-    removeZeros();
+    normalize();
     return *this;
   }
   CPolynomial& operator*=(const CPolynomial& other) {
-    std::vector<std::pair<int, double>> result;
-    for (const auto& [deg1, coeff1] : coefficients) {
-        for (const auto& [deg2, coeff2] : other.coefficients) {
-            bool found = false;
-            for (auto& [degResult, coeffResult] : result) {
-                if (degResult == deg1 + deg2) {
-                    coeffResult += coeff1 * coeff2;
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                result.emplace_back(deg1 + deg2, coeff1 * coeff2);
-            }
-        }
+    CPolynomial result;
+    multiply(*this, other, result);
+    *this = move(result);
+    return *this;
+  }
+  template <typename TExpr>
+  CPolynomial& operator+=(const CPolyExpr<TExpr>& expr) {
+    if (expr.self().aliases(this)) {
+      CPolynomial value(expr);
+      value.addTo(*this, 1.0);
+    } else {
+      expr.self().addTo(*this, 1.0);
     }
-    coefficients = move(result);
-    removeZeros();
+    normalize();
     return *this;
   }
+  template <typename TExpr>
+  CPolynomial& operator-=(const CPolyExpr<TExpr>& expr) {
+    return *this += expr.self() * -1.0;
+  }
   bool operator==(const CPolynomial& other) const {
-    auto filteredA = coefficients;
-    auto filteredB = other.coefficients;
-
-    filteredA.erase(remove_if(filteredA.begin(), filteredA.end(), 
-                                   [](const auto& coeff) { return coeff.second == 0.0; }), 
-                    filteredA.end());
-    
-    filteredB.erase(remove_if(filteredB.begin(), filteredB.end(), 
-                                   [](const auto& coeff) { return coeff.second == 0.0; }), 
-                    filteredB.end());
-
-  
-    return filteredA == filteredB;
+    TermCursor a(*this), b(other);
+    int degA, degB;
+    double valueA, valueB;
+    while (true) {
+      bool hasA = a.next(degA, valueA);
+      bool hasB = b.next(degB, valueB);
+      if (!hasA || !hasB) {
+        return hasA == hasB;
+      }
+      if (degA != degB || valueA != valueB) {
+        return false;
+      }
+    }
   }
 
   bool operator!=(const CPolynomial& other) const {
-    return coefficients != other.coefficients;
+    return !(*this == other);
   }
   double& operator[](int degree) 
   {
-    for (auto& coeff : coefficients) {
-        if (coeff.first == degree) {
-            return coeff.second;
-        }
+    if (dense) {
+      if ((size_t)degree < values.size()) {
+          return values[degree];
+      }
+      if ((size_t)degree < 2 * values.size() + DENSE_SLACK) {
+          values.resize(degree + 1, 0.0);
+          return values[degree];
+      }
+      toSparse();
     }
-    coefficients.emplace_back(degree, 0.0);
-    return coefficients.back().second;
+    auto it = findTerm(degree);
+    if (it != coefficients.end() && it->first == degree) {
+        return it->second;
+    }
+    return coefficients.emplace(it, degree, 0.0)->second;
   }
   const double operator[](int degree) const 
   {
-    for (const auto& coeff : coefficients) {
-        if (coeff.first == degree) {
-            return coeff.second;
-        }
+    if (dense) {
+      return (size_t)degree < values.size() ? values[degree] : 0.0;
+    }
+    auto it = findTerm(degree);
+    if (it != coefficients.end() && it->first == degree) {
+        return it->second;
     }
     return 0.0;
   }
   unsigned degree() const 
   {
-    unsigned maxDeg = 0;
-    for (const auto& [deg, coeff] : coefficients) {
-        if (fabs(coeff) > 1e-9) { 
-            maxDeg = max(maxDeg, (unsigned)deg);
+    if (dense) {
+      for (size_t deg = values.size(); deg-- > 0; ) {
+          if (fabs(values[deg]) > 1e-9) {
+              return deg;
+          }
+      }
+      return 0;
+    }
+    for (auto it = coefficients.rbegin(); it != coefficients.rend(); ++it) {
+        if (fabs(it->second) > 1e-9) { 
+            return it->first;
         }
     }
-    return maxDeg;
+    return 0;
   }
   double operator()(double x) const 
   {
-    double result = 0.0;
-    for (const auto& coeff : coefficients) {
-        result += coeff.second * pow(x, coeff.first);
+    if (dense) {
+      return hornerDense(x);
     }
-    return result;
+    return hornerSparse(x);
   }
-  explicit operator bool() const {
-    for (const auto& [deg, coeff] : coefficients) {
-        if (coeff != 0.0) return true;
+  // evaluates at every xs[i] into out[i]; blocks of points are evaluated
+  // side by side so the Horner steps of different points vectorize
+  void evaluate(span<const double> xs, span<double> out, unsigned threads = 1) const
+  {
+    assert(xs.size() == out.size());
+    if (threads <= 1 || xs.size() < PARALLEL_EVAL_THRESHOLD) {
+      evaluateRange(xs, out);
+      return;
     }
-    return false;
+    vector<thread> workers;
+    size_t chunk = (xs.size() + threads - 1) / threads;
+    for (size_t begin = 0; begin < xs.size(); begin += chunk) {
+      size_t len = min(chunk, xs.size() - begin);
+      workers.emplace_back([this, xs, out, begin, len]() {
+          evaluateRange(xs.subspan(begin, len), out.subspan(begin, len));
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+  explicit operator bool() const {
+    int deg;
+    double value;
+    return TermCursor(*this).next(deg, value);
   }
   bool operator!() const {
     return static_cast<bool>(*this) == false;
   }
+  bool isDense() const {
+    return dense;
+  }
+
+  // a = b * q + r with deg r < deg b; throws on division by the zero polynomial
+  friend void divmod(const CPolynomial& a, const CPolynomial& b, CPolynomial& q, CPolynomial& r) {
+    vector<double> quotient, remainder;
+    divide(a.toVector(), b.toVector(), quotient, remainder);
+    q = fromVector(move(quotient));
+    r = fromVector(move(remainder));
+  }
+  friend CPolynomial operator/(const CPolynomial& a, const CPolynomial& b) {
+    CPolynomial q, r;
+    divmod(a, b, q, r);
+    return q;
+  }
+  friend CPolynomial operator%(const CPolynomial& a, const CPolynomial& b) {
+    CPolynomial q, r;
+    divmod(a, b, q, r);
+    return r;
+  }
+  // monic greatest common divisor; remainder coefficients below
+  // GCD_EPSILON relative to the divisor are treated as rounding noise
+  friend CPolynomial gcd(const CPolynomial& a, const CPolynomial& b) {
+    vector<double> x = a.toVector(), y = b.toVector(), quotient, remainder;
+    while (!y.empty()) {
+      divide(x, y, quotient, remainder);
+      double scale = 0.0;
+      for (double value : y) {
+        scale = max(scale, fabs(value));
+      }
+      for (double& value : remainder) {
+        if (fabs(value) <= GCD_EPSILON * scale) value = 0.0;
+      }
+      trim(remainder);
+      x = move(y);
+      y = move(remainder);
+    }
+    if (!x.empty()) {
+      double lead = x.back();
+      for (double& value : x) {
+        value /= lead;
+      }
+    }
+    return fromVector(move(x));
+  }
+
+  // evaluates at all xs[i] by reducing the polynomial down a subproduct
+  // tree of (x - xs[i]); xs.size() = n costs O(M(n) log n) instead of O(n deg)
+  void evaluateMultipoint(span<const double> xs, span<double> out) const {
+    assert(xs.size() == out.size());
+    if (xs.empty()) {
+      return;
+    }
+    SubproductTree tree = buildSubproductTree(xs);
+    remainderDown(tree, tree.size() - 1, 0, toVector(), out);
+  }
+  // the polynomial of degree < n through (xs[i], ys[i]); xs must be distinct
+  static CPolynomial interpolate(span<const double> xs, span<const double> ys) {
+    assert(xs.size() == ys.size());
+    if (xs.empty()) {
+      return CPolynomial();
+    }
+    SubproductTree tree = buildSubproductTree(xs);
+
+    // Lagrange weights y_i / M'(x_i) for M = prod (x - x_j)
+    const vector<double>& root = tree.back()[0];
+    vector<double> derivative(root.size() - 1);
+    for (size_t i = 1; i < root.size(); ++i) {
+      derivative[i - 1] = root[i] * i;
+    }
+    vector<double> weights(xs.size());
+    remainderDown(tree, tree.size() - 1, 0, derivative, weights);
+
+    vector<vector<double>> current(xs.size());
+    for (size_t i = 0; i < xs.size(); ++i) {
+      current[i] = {ys[i] / weights[i]};
+    }
+    // node = left * M_right + right * M_left
+    for (size_t level = 0; level + 1 < tree.size(); ++level) {
+      vector<vector<double>> next((current.size() + 1) / 2);
+      for (size_t i = 0; i < next.size(); ++i) {
+        if (2 * i + 1 == current.size()) {
+          next[i] = move(current[2 * i]);
+          continue;
+        }
+        vector<double> left, right;
+        multiplyDense(current[2 * i], tree[level][2 * i + 1], left);
+        multiplyDense(current[2 * i + 1], tree[level][2 * i], right);
+        if (left.size() < right.size()) {
+          swap(left, right);
+        }
+        for (size_t j = 0; j < right.size(); ++j) {
+          left[j] += right[j];
+        }
+        next[i] = move(left);
+      }
+      current = move(next);
+    }
+    return fromVector(move(current[0]));
+  }
+
+  // expression protocol: dst += factor * (*this)
+  void addTo(CPolynomial& dst, double factor) const {
+    if (dst.empty()) {
+      dst.dense = dense;
+      if (dense) {
+        dst.values.resize(values.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+          dst.values[i] = values[i] * factor;
+        }
+      } else {
+        dst.coefficients.resize(coefficients.size());
+        for (size_t i = 0; i < coefficients.size(); ++i) {
+          dst.coefficients[i] = {coefficients[i].first, coefficients[i].second * factor};
+        }
+      }
+    } else if (dst.dense && dense) {
+      if (dst.values.size() < values.size()) {
+        dst.values.resize(values.size(), 0.0);
+      }
+      for (size_t i = 0; i < values.size(); ++i) {
+        dst.values[i] += values[i] * factor;
+      }
+    } else {
+      Terms result;
+      addTerms(dst.dense ? dst.sparseTerms() : dst.coefficients, dense ? sparseTerms() : coefficients, result, factor);
+      dst.values.clear();
+      dst.dense = false;
+      dst.coefficients = move(result);
+    }
+  }
+  bool aliases(const CPolynomial* poly) const {
+    return this == poly;
+  }
+  // dst += factor * a * b
+  static void addProductTo(CPolynomial& dst, const CPolynomial& a, const CPolynomial& b, double factor) {
+    if (dst.empty()) {
+      multiply(a, b, dst, factor);
+      return;
+    }
+    CPolynomial product;
+    multiply(a, b, product, factor);
+    product.addTo(dst, 1.0);
+  }
   private:
-  vector<pair<int, double>> coefficients;
+  template <unsigned N>
+  friend class CFixedPolynomial;
+
+  using Terms = vector<pair<int, double>>;
+
+  // a dense slot costs 8 bytes, a sparse term 16: dense pays off from 50 % fill,
+  // the gap down to 25 % keeps a polynomial from flipping back and forth
+  static constexpr size_t DENSE_FILL_NUM = 1, DENSE_FILL_DEN = 2;
+  static constexpr size_t SPARSE_FILL_NUM = 1, SPARSE_FILL_DEN = 4;
+  static constexpr size_t DENSE_SLACK = 8;
+
+  bool dense = false;
+  // dense form: values[i] is the coefficient of x^i
+  vector<double> values;
+  // sparse form: terms sorted by ascending degree, at most one term per degree
+  Terms coefficients;
+
+  // walks the nonzero terms in ascending degree in either form
+  struct TermCursor {
+    const CPolynomial& poly;
+    size_t index = 0;
+
+    explicit TermCursor(const CPolynomial& poly) : poly(poly) {}
+
+    bool next(int& deg, double& value) {
+      if (poly.dense) {
+        while (index < poly.values.size() && poly.values[index] == 0.0) ++index;
+        if (index == poly.values.size()) return false;
+        deg = index;
+        value = poly.values[index++];
+        return true;
+      }
+      while (index < poly.coefficients.size() && poly.coefficients[index].second == 0.0) ++index;
+      if (index == poly.coefficients.size()) return false;
+      deg = poly.coefficients[index].first;
+      value = poly.coefficients[index++].second;
+      return true;
+    }
+  };
+
+  template <typename F>
+  void forEachTerm(F&& visit) const {
+    int deg;
+    double value;
+    for (TermCursor cursor(*this); cursor.next(deg, value); ) {
+      visit(deg, value);
+    }
+  }
+  template <typename F>
+  void forEachTermDescending(F&& visit) const {
+    if (dense) {
+      for (size_t deg = values.size(); deg-- > 0; ) {
+        if (values[deg] != 0.0) visit((int)deg, values[deg]);
+      }
+      return;
+    }
+    for (auto it = coefficients.rbegin(); it != coefficients.rend(); ++it) {
+      if (it->second != 0.0) visit(it->first, it->second);
+    }
+  }
+
+  // matches the default precision of an ostream
+  static constexpr int FORMAT_PRECISION = 6;
+  static constexpr size_t EVAL_BLOCK = 8;
+  static constexpr size_t PARALLEL_EVAL_THRESHOLD = 1 << 16;
+  // term pairs each extra thread of a sparse product should get
+  static constexpr size_t PARALLEL_MULTIPLY_PAIRS = 1 << 20;
+
+  static double powInt(double x, unsigned exponent) {
+    double result = 1.0;
+    while (exponent) {
+      if (exponent & 1) result *= x;
+      x *= x;
+      exponent >>= 1;
+    }
+    return result;
+  }
+
+  // Estrin's scheme inside groups of four coefficients, Horner in x^4
+  // across the groups: the two halves of each group are independent
+  double hornerDense(double x) const {
+    const size_t n = values.size();
+    const double x2 = x * x, x4 = x2 * x2;
+    auto at = [&](size_t i) { return i < n ? values[i] : 0.0; };
+    double result = 0.0;
+    for (size_t group = (n + 3) / 4; group-- > 0; ) {
+      size_t i = 4 * group;
+      double low = at(i) + at(i + 1) * x;
+      double high = at(i + 2) + at(i + 3) * x;
+      result = result * x4 + (low + high * x2);
+    }
+    return result;
+  }
+
+  // Horner over the sorted terms, gaps between degrees bridged by x^gap
+  double hornerSparse(double x) const {
+    double result = 0.0;
+    int previous = 0;
+    bool first = true;
+    for (auto it = coefficients.rbegin(); it != coefficients.rend(); ++it) {
+      if (!first) {
+        result *= powInt(x, previous - it->first);
+      }
+      result += it->second;
+      previous = it->first;
+      first = false;
+    }
+    return first ? 0.0 : result * powInt(x, previous);
+  }
+
+  void evaluateRange(span<const double> xs, span<double> out) const {
+    if (!dense) {
+      for (size_t i = 0; i < xs.size(); ++i) {
+        out[i] = hornerSparse(xs[i]);
+      }
+      return;
+    }
+    const size_t n = values.size();
+    for (size_t base = 0; base < xs.size(); base += EVAL_BLOCK) {
+      size_t count = min(EVAL_BLOCK, xs.size() - base);
+      double x[EVAL_BLOCK] = {}, acc[EVAL_BLOCK] = {};
+      for (size_t j = 0; j < count; ++j) {
+        x[j] = xs[base + j];
+      }
+      for (size_t i = n; i-- > 0; ) {
+        const double coeff = values[i];
+        for (size_t j = 0; j < EVAL_BLOCK; ++j) {
+          acc[j] = acc[j] * x[j] + coeff;
+        }
+      }
+      for (size_t j = 0; j < count; ++j) {
+        out[base + j] = acc[j];
+      }
+    }
+  }
+
+  Terms::iterator findTerm(int degree) {
+    return lower_bound(coefficients.begin(), coefficients.end(), degree, [](const auto& coeff, int deg) {
+        return coeff.first < deg;
+    });
+  }
+  Terms::const_iterator findTerm(int degree) const {
+    return lower_bound(coefficients.begin(), coefficients.end(), degree, [](const auto& coeff, int deg) {
+        return coeff.first < deg;
+    });
+  }
+
+  static constexpr double GCD_EPSILON = 1e-9;
+  static constexpr size_t NEWTON_DIVISION_THRESHOLD = 128;
+
+  // tree[0][i] = x - xs[i], tree[l + 1][i] = tree[l][2i] * tree[l][2i + 1]
+  using SubproductTree = vector<vector<vector<double>>>;
+
+  static void trim(vector<double>& poly) {
+    while (!poly.empty() && poly.back() == 0.0) {
+      poly.pop_back();
+    }
+  }
+
+  // coefficients from x^0 up to the highest nonzero one
+  vector<double> toVector() const {
+    vector<double> result;
+    if (dense) {
+      result = values;
+    } else if (!coefficients.empty()) {
+      result.assign(coefficients.back().first + 1, 0.0);
+      for (const auto& [deg, value] : coefficients) {
+        result[deg] = value;
+      }
+    }
+    trim(result);
+    return result;
+  }
+  static CPolynomial fromVector(vector<double>&& poly) {
+    CPolynomial result;
+    result.dense = true;
+    result.values = move(poly);
+    result.normalize();
+    return result;
+  }
+
+  static void divide(const vector<double>& a, const vector<double>& b, vector<double>& quotient, vector<double>& remainder) {
+    if (b.empty()) {
+      throw invalid_argument("division by zero polynomial");
+    }
+    if (a.size() < b.size()) {
+      quotient.clear();
+      remainder = a;
+      return;
+    }
+    size_t quotientSize = a.size() - b.size() + 1;
+    if (min(quotientSize, b.size()) < NEWTON_DIVISION_THRESHOLD) {
+      divideLong(a, b, quotient, remainder);
+    } else {
+      divideNewton(a, b, quotient, remainder);
+    }
+    trim(quotient);
+    trim(remainder);
+  }
+
+  static void divideLong(const vector<double>& a, const vector<double>& b, vector<double>& quotient, vector<double>& remainder) {
+    const size_t m = b.size();
+    const double lead = b.back();
+    remainder = a;
+    quotient.assign(a.size() - m + 1, 0.0);
+    for (size_t i = quotient.size(); i-- > 0; ) {
+      double coeff = remainder[i + m - 1] / lead;
+      quotient[i] = coeff;
+      if (coeff == 0.0) continue;
+      double* row = remainder.data() + i;
+      for (size_t j = 0; j < m; ++j) {
+        row[j] -= coeff * b[j];
+      }
+    }
+    remainder.resize(m - 1);
+  }
+
+  // 1 / f mod x^k by Newton iteration g <- g (2 - f g), doubling the precision
+  static vector<double> inverseSeries(const vector<double>& f, size_t k) {
+    vector<double> g = {1.0 / f[0]}, fg, next;
+    for (size_t len = 1; len < k; ) {
+      len = min(2 * len, k);
+      vector<double> head(f.begin(), f.begin() + min(f.size(), len));
+      multiplyDense(head, g, fg);
+      fg.resize(len, 0.0);
+      for (double& value : fg) {
+        value = -value;
+      }
+      fg[0] += 2.0;
+      multiplyDense(g, fg, next);
+      next.resize(len, 0.0);
+      g.swap(next);
+    }
+    g.resize(k, 0.0);
+    return g;
+  }
+
+  // rev(q) = rev(a) / rev(b) mod x^(n - m + 1), then r = a - b q
+  static void divideNewton(const vector<double>& a, const vector<double>& b, vector<double>& quotient, vector<double>& remainder) {
+    const size_t k = a.size() - b.size() + 1;
+    vector<double> reversedA(a.rbegin(), a.rbegin() + k);
+    vector<double> reversedB(b.rbegin(), b.rend());
+    vector<double> reversedQ;
+    multiplyDense(reversedA, inverseSeries(reversedB, k), reversedQ);
+    reversedQ.resize(k, 0.0);
+    quotient.assign(reversedQ.rbegin(), reversedQ.rend());
+
+    vector<double> product;
+    multiplyDense(b, quotient, product);
+    remainder.assign(a.begin(), a.begin() + (b.size() - 1));
+    for (size_t i = 0; i < remainder.size() && i < product.size(); ++i) {
+      remainder[i] -= product[i];
+    }
+  }
+
+  static SubproductTree buildSubproductTree(span<const double> xs) {
+    SubproductTree tree(1);
+    for (double x : xs) {
+      tree[0].push_back({-x, 1.0});
+    }
+    while (tree.back().size() > 1) {
+      const auto& below = tree.back();
+      vector<vector<double>> level((below.size() + 1) / 2);
+      for (size_t i = 0; i < level.size(); ++i) {
+        if (2 * i + 1 < below.size()) {
+          multiplyDense(below[2 * i], below[2 * i + 1], level[i]);
+        } else {
+          level[i] = below[2 * i];
+        }
+      }
+      tree.push_back(move(level));
+    }
+    return tree;
+  }
+
+  static void remainderDown(const SubproductTree& tree, size_t level, size_t index, const vector<double>& poly, span<double> out) {
+    vector<double> quotient, remainder;
+    divide(poly, tree[level][index], quotient, remainder);
+    if (level == 0) {
+      out[index] = remainder.empty() ? 0.0 : remainder[0];
+      return;
+    }
+    remainderDown(tree, level - 1, 2 * index, remainder, out);
+    if (2 * index + 1 < tree[level - 1].size()) {
+      remainderDown(tree, level - 1, 2 * index + 1, remainder, out);
+    }
+  }
+
+  Terms sparseTerms() const {
+    Terms terms;
+    forEachTerm([&](int deg, double value) {
+        terms.emplace_back(deg, value);
+    });
+    return terms;
+  }
+
+  void toSparse() {
+    if (!dense) return;
+    coefficients = sparseTerms();
+    values.clear();
+    values.shrink_to_fit();
+    dense = false;
+  }
+  void toDense() {
+    if (dense) return;
+    values.assign(coefficients.empty() ? 0 : coefficients.back().first + 1, 0.0);
+    for (const auto& [deg, value] : coefficients) {
+      values[deg] = value;
+    }
+    coefficients.clear();
+    coefficients.shrink_to_fit();
+    dense = true;
+  }
+
+  // drops zero terms and picks the cheaper form for the current fill ratio
+  void normalize() {
+    size_t nonZero = 0, span = 0;
+    if (dense) {
+      while (!values.empty() && values.back() == 0.0) values.pop_back();
+      for (double value : values) {
+        nonZero += value != 0.0;
+      }
+      span = values.size();
+    } else {
+      coefficients.erase(std::remove_if(coefficients.begin(), coefficients.end(), [](const auto& coeff) {
+          return coeff.second == 0.0;
+      }), coefficients.end());
+      nonZero = coefficients.size();
+      span = coefficients.empty() ? 0 : coefficients.back().first + 1;
+    }
+
+    if (nonZero == 0) {
+      dense = false;
+      values.clear();
+      coefficients.clear();
+    } else if (!dense && nonZero * DENSE_FILL_DEN >= span * DENSE_FILL_NUM) {
+      toDense();
+    } else if (dense && nonZero * SPARSE_FILL_DEN < span * SPARSE_FILL_NUM) {
+      toSparse();
+    }
+  }
+
+  bool empty() const {
+    return values.empty() && coefficients.empty();
+  }
+
+  // evaluates an expression into this polynomial, reusing its storage
+  // unless the expression reads from it
+  template <typename TExpr>
+  void assign(const TExpr& expr) {
+    if (expr.aliases(this)) {
+      CPolynomial result;
+      expr.addTo(result, 1.0);
+      *this = move(result);
+    } else {
+      values.clear();
+      coefficients.clear();
+      dense = false;
+      expr.addTo(*this, 1.0);
+    }
+    normalize();
+  }
+
+  // result = factor * a * b; result must not alias a or b
+  static void multiply(const CPolynomial& a, const CPolynomial& b, CPolynomial& result, double factor = 1.0) {
+    if (a.dense && b.dense) {
+      result.dense = true;
+      result.coefficients.clear();
+      multiplyDense(a.values, b.values, result.values);
+      if (factor != 1.0) {
+        for (double& value : result.values) {
+          value *= factor;
+        }
+      }
+    } else {
+      result.dense = false;
+      result.values.clear();
+      multiplyTerms(a.dense ? a.sparseTerms() : a.coefficients, b.dense ? b.sparseTerms() : b.coefficients, result.coefficients, factor);
+    }
+    result.normalize();
+  }
+
+  // Dense products dispatch on the shorter operand: schoolbook below
+  // KARATSUBA_THRESHOLD, Karatsuba below FFT_THRESHOLD, FFT above.
+  //
+  // Error bounds (eps = 2^-53, N = FFT length, a and b the operands):
+  //  - schoolbook: |err_k| <= n * eps * sum_i |a_i| |b_(k-i)|, the same as the
+  //    original nested loops - small inputs like those in main() are unchanged;
+  //  - Karatsuba: the (aLow + aHigh)(bLow + bHigh) - z0 - z2 cancellation adds a
+  //    factor of about 3 per level, |err_k| <~ 3^log2(n / 32) * n * eps * |a|_inf * |b|_inf;
+  //  - FFT: the error is spread evenly over all coefficients,
+  //    |err_k| <~ 3 * eps * log2(N) * |a|_2 * |b|_2.
+  // With coefficients in [-1, 1] and degree 10^6 (N = 2^21, |a|_2 |b|_2 ~ 10^6)
+  // that is ~ 7e-9 worst case and ~ 1e-12 rms, so the absolute 1e-9 smallDiff
+  // tolerance only holds for large FFT products when coefficients are small.
+  static constexpr size_t KARATSUBA_THRESHOLD = 32;
+  static constexpr size_t FFT_THRESHOLD = 512;
+
+  static void multiplyDense(const vector<double>& a, const vector<double>& b, vector<double>& result) {
+    if (a.empty() || b.empty()) {
+      result.clear();
+      return;
+    }
+    const vector<double>& shorter = a.size() <= b.size() ? a : b;
+    const vector<double>& longer = a.size() <= b.size() ? b : a;
+    if (shorter.size() < KARATSUBA_THRESHOLD) {
+      result.assign(a.size() + b.size() - 1, 0.0);
+      multiplySchoolbook(shorter.data(), shorter.size(), longer.data(), longer.size(), result.data());
+    } else if (shorter.size() < FFT_THRESHOLD) {
+      multiplyKaratsuba(shorter, longer, result);
+    } else {
+      multiplyFFT(a, b, result);
+    }
+  }
+
+  // out[i + j] += a[i] * b[j]
+  static void multiplySchoolbook(const double* a, size_t n, const double* b, size_t m, double* out) {
+    for (size_t i = 0; i < n; ++i) {
+      const double coeff = a[i];
+      double* row = out + i;
+      for (size_t j = 0; j < m; ++j) {
+        row[j] += coeff * b[j];
+      }
+    }
+  }
+
+  // the longer operand is cut into blocks as long as the shorter one
+  static void multiplyKaratsuba(const vector<double>& shorter, const vector<double>& longer, vector<double>& result) {
+    const size_t n = shorter.size();
+    result.assign(shorter.size() + longer.size() - 1, 0.0);
+    vector<double> work(7 * n);
+    double* block = work.data();
+    double* product = block + n;
+    double* scratch = product + 2 * n;
+    for (size_t offset = 0; offset < longer.size(); offset += n) {
+      size_t len = min(n, longer.size() - offset);
+      copy(longer.begin() + offset, longer.begin() + offset + len, block);
+      fill(block + len, block + n, 0.0);
+      karatsuba(shorter.data(), block, n, product, scratch);
+      size_t used = min(2 * n - 1, result.size() - offset);
+      for (size_t i = 0; i < used; ++i) {
+        result[offset + i] += product[i];
+      }
+    }
+  }
+
+  // out[0 .. 2n-1) = a[0 .. n) * b[0 .. n); scratch needs 4n doubles
+  static void karatsuba(const double* a, const double* b, size_t n, double* out, double* scratch) {
+    if (n < KARATSUBA_THRESHOLD) {
+      fill(out, out + 2 * n - 1, 0.0);
+      multiplySchoolbook(a, n, b, n, out);
+      return;
+    }
+    const size_t low = n / 2, high = n - low;
+    double* sumA = scratch;
+    double* sumB = scratch + high;
+    double* middle = scratch + 2 * high;      // 2 * high - 1 values
+    double* deeper = scratch + 4 * high;
+
+    for (size_t i = 0; i < high; ++i) {
+      sumA[i] = a[low + i] + (i < low ? a[i] : 0.0);
+      sumB[i] = b[low + i] + (i < low ? b[i] : 0.0);
+    }
+    karatsuba(a, b, low, out, deeper);
+    out[2 * low - 1] = 0.0;
+    karatsuba(a + low, b + low, high, out + 2 * low, deeper);
+    karatsuba(sumA, sumB, high, middle, deeper);
+
+    for (size_t i = 0; i < 2 * low - 1; ++i) {
+      middle[i] -= out[i];
+    }
+    for (size_t i = 0; i < 2 * high - 1; ++i) {
+      middle[i] -= out[2 * low + i];
+    }
+    for (size_t i = 0; i < 2 * high - 1; ++i) {
+      out[low + i] += middle[i];
+    }
+  }
+
+  static void fft(vector<complex<double>>& data, bool inverse) {
+    const size_t n = data.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+      size_t bit = n >> 1;
+      for (; j & bit; bit >>= 1) {
+        j ^= bit;
+      }
+      j ^= bit;
+      if (i < j) {
+        swap(data[i], data[j]);
+      }
+    }
+
+    // twiddles are computed directly, not by repeated multiplication,
+    // so their error does not grow with the transform length
+    vector<complex<double>> roots(n / 2);
+    for (size_t k = 0; k < n / 2; ++k) {
+      double angle = 2 * M_PI * k / n * (inverse ? 1 : -1);
+      roots[k] = complex<double>(cos(angle), sin(angle));
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+      size_t step = n / len;
+      for (size_t i = 0; i < n; i += len) {
+        for (size_t j = 0; j < len / 2; ++j) {
+          complex<double> u = data[i + j];
+          complex<double> v = data[i + j + len / 2] * roots[j * step];
+          data[i + j] = u + v;
+          data[i + j + len / 2] = u - v;
+        }
+      }
+    }
+    if (inverse) {
+      for (auto& value : data) {
+        value /= (double)n;
+      }
+    }
+  }
+
+  // both real operands share one complex transform (a in the real part,
+  // b in the imaginary part), their spectra are separated afterwards
+  static void multiplyFFT(const vector<double>& a, const vector<double>& b, vector<double>& result) {
+    const size_t resultSize = a.size() + b.size() - 1;
+    size_t n = 1;
+    while (n < resultSize) {
+      n <<= 1;
+    }
+
+    vector<complex<double>> packed(n);
+    for (size_t i = 0; i < a.size(); ++i) {
+      packed[i].real(a[i]);
+    }
+    for (size_t i = 0; i < b.size(); ++i) {
+      packed[i].imag(b[i]);
+    }
+    fft(packed, false);
 
-  void removeZeros() {
-    coefficients.erase(std::remove_if(coefficients.begin(), coefficients.end(), [](const auto& coeff) {
-        return coeff.second == 0.0;
-    }), coefficients.end());
-    if (coefficients.empty()) {
-        coefficients.emplace_back(0, 0.0);
+    vector<complex<double>> product(n);
+    for (size_t k = 0; k < n; ++k) {
+      complex<double> x = packed[k];
+      complex<double> y = conj(packed[(n - k) & (n - 1)]);
+      product[k] = (x * x - y * y) * complex<double>(0, -0.25);
     }
+    fft(product, true);
+
+    // The transform leaves noise up to the error bound above even where the
+    // exact product is zero. Values below the bound are dropped so that
+    // normalize() sees those zeros; integer operands are rounded instead
+    // while the bound keeps the nearest integer exact.
+    double normA = 0, normB = 0;
+    bool integral = true;
+    for (double value : a) {
+      normA += value * value;
+      integral = integral && value == nearbyint(value);
+    }
+    for (double value : b) {
+      normB += value * value;
+      integral = integral && value == nearbyint(value);
+    }
+    const double bound = 3 * DBL_EPSILON * log2(double(n)) * sqrt(normA) * sqrt(normB);
+    const bool round = integral && bound < 0.25;
+
+    result.resize(resultSize);
+    for (size_t i = 0; i < resultSize; ++i) {
+      const double value = product[i].real();
+      result[i] = round ? nearbyint(value) : fabs(value) <= bound ? 0.0 : value;
+    }
+  }
+
+  // result = a + factor * b
+  static void addTerms(const Terms& a, const Terms& b, Terms& result, double factor = 1.0) {
+    result.clear();
+    result.reserve(a.size() + b.size());
+    auto i = a.begin(), j = b.begin();
+    while (i != a.end() || j != b.end()) {
+      if (j == b.end() || (i != a.end() && i->first < j->first)) {
+        result.push_back(*i++);
+      } else if (i == a.end() || j->first < i->first) {
+        result.emplace_back(j->first, j->second * factor);
+        ++j;
+      } else {
+        result.emplace_back(i->first, i->second + j->second * factor);
+        ++i;
+        ++j;
+      }
+      if (result.back().second == 0.0) {
+        result.pop_back();
+      }
+    }
+  }
+
+  // Johnson's heap multiplication: one cursor per term of the shorter
+  // operand walks the longer one, products come out in degree order
+  // and are summed as they leave the heap - O(nm log n), no lookups.
+  // Large products split the shorter operand across threads, each slice
+  // is multiplied into its own sorted buffer and the buffers are merged.
+  static void multiplyTerms(const Terms& a, const Terms& b, Terms& result, double factor = 1.0) {
+    result.clear();
+    const Terms& shorter = a.size() <= b.size() ? a : b;
+    const Terms& longer = a.size() <= b.size() ? b : a;
+    if (shorter.empty()) {
+      return;
+    }
+
+    size_t threads = min<size_t>({thread::hardware_concurrency(), shorter.size(),
+                                  shorter.size() * longer.size() / PARALLEL_MULTIPLY_PAIRS});
+    if (threads <= 1) {
+      multiplyTermsSlice(shorter.data(), shorter.size(), longer, result, factor);
+      return;
+    }
+
+    vector<Terms> parts(threads);
+    vector<thread> workers;
+    size_t chunk = (shorter.size() + threads - 1) / threads;
+    for (size_t t = 0; t < threads; ++t) {
+      size_t begin = min(t * chunk, shorter.size());
+      size_t count = min(chunk, shorter.size() - begin);
+      workers.emplace_back([&, t, begin, count]() {
+          multiplyTermsSlice(shorter.data() + begin, count, longer, parts[t], factor);
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    mergeTerms(parts, result);
+  }
+
+  static void multiplyTermsSlice(const pair<int, double>* shorter, size_t count, const Terms& longer, Terms& result, double factor) {
+    result.clear();
+    if (count == 0) {
+      return;
+    }
+    using Cursor = pair<int, size_t>;  // (product degree, index in shorter)
+    vector<size_t> position(count, 0);
+    priority_queue<Cursor, vector<Cursor>, greater<Cursor>> heap;
+    for (size_t i = 0; i < count; ++i) {
+      heap.emplace(shorter[i].first + longer[0].first, i);
+    }
+
+    while (!heap.empty()) {
+      auto [deg, i] = heap.top();
+      heap.pop();
+      double product = shorter[i].second * longer[position[i]].second * factor;
+      appendTerm(result, deg, product);
+      if (++position[i] < longer.size()) {
+        heap.emplace(shorter[i].first + longer[position[i]].first, i);
+      }
+    }
+    if (!result.empty() && result.back().second == 0.0) {
+      result.pop_back();
+    }
+  }
+
+  // k-way merge of sorted term lists, equal degrees are summed
+  static void mergeTerms(const vector<Terms>& parts, Terms& result) {
+    using Cursor = pair<int, size_t>;  // (degree, part)
+    vector<size_t> position(parts.size(), 0);
+    priority_queue<Cursor, vector<Cursor>, greater<Cursor>> heap;
+    size_t total = 0;
+    for (size_t p = 0; p < parts.size(); ++p) {
+      total += parts[p].size();
+      if (!parts[p].empty()) {
+        heap.emplace(parts[p][0].first, p);
+      }
+    }
+    result.clear();
+    result.reserve(total);
+    while (!heap.empty()) {
+      auto [deg, p] = heap.top();
+      heap.pop();
+      appendTerm(result, deg, parts[p][position[p]].second);
+      if (++position[p] < parts[p].size()) {
+        heap.emplace(parts[p][position[p]].first, p);
+      }
+    }
+    if (!result.empty() && result.back().second == 0.0) {
+      result.pop_back();
+    }
+  }
+
+  // appends to a list built in ascending degree order; a finished term
+  // that summed up to zero is dropped when the next degree starts
+  static void appendTerm(Terms& result, int deg, double value) {
+    if (!result.empty() && result.back().first == deg) {
+      result.back().second += value;
+      return;
+    }
+    if (!result.empty() && result.back().second == 0.0) {
+      result.pop_back();
+    }
+    result.emplace_back(deg, value);
+  }
+};
+
+template <typename TExpr>
+struct CPolyOperand
+{
+  using type = TExpr;
+};
+
+template <>
+struct CPolyOperand<CPolynomial>
+{
+  using type = const CPolynomial&;
+};
+
+template <typename TExpr>
+struct CPolyScaled : CPolyExpr<CPolyScaled<TExpr>>
+{
+  typename CPolyOperand<TExpr>::type expr;
+  double factor;
+
+  CPolyScaled(const TExpr& expr, double factor) : expr(expr), factor(factor) {}
+
+  void addTo(CPolynomial& dst, double scale) const { expr.addTo(dst, scale * factor); }
+  bool aliases(const CPolynomial* poly) const { return expr.aliases(poly); }
+};
+
+template <typename TLeft, typename TRight>
+struct CPolySum : CPolyExpr<CPolySum<TLeft, TRight>>
+{
+  typename CPolyOperand<TLeft>::type left;
+  typename CPolyOperand<TRight>::type right;
+
+  CPolySum(const TLeft& left, const TRight& right) : left(left), right(right) {}
+
+  void addTo(CPolynomial& dst, double scale) const
+  {
+    left.addTo(dst, scale);
+    right.addTo(dst, scale);
+  }
+  bool aliases(const CPolynomial* poly) const { return left.aliases(poly) || right.aliases(poly); }
+};
+
+struct CPolyProduct : CPolyExpr<CPolyProduct>
+{
+  const CPolynomial& left;
+  const CPolynomial& right;
+  double factor;
+
+  CPolyProduct(const CPolynomial& left, const CPolynomial& right, double factor = 1.0)
+    : left(left), right(right), factor(factor) {}
+
+  void addTo(CPolynomial& dst, double scale) const { CPolynomial::addProductTo(dst, left, right, scale * factor); }
+  bool aliases(const CPolynomial* poly) const { return &left == poly || &right == poly; }
+};
+
+template <typename TExpr>
+CPolyScaled<TExpr> operator*(const CPolyExpr<TExpr>& expr, double factor)
+{
+  return CPolyScaled<TExpr>(expr.self(), factor);
+}
+
+template <typename TExpr>
+CPolyScaled<TExpr> operator*(const CPolyScaled<TExpr>& expr, double factor)
+{
+  return CPolyScaled<TExpr>(expr.expr, expr.factor * factor);
+}
+
+inline CPolyProduct operator*(const CPolyProduct& expr, double factor)
+{
+  return CPolyProduct(expr.left, expr.right, expr.factor * factor);
+}
+
+inline CPolyProduct operator*(const CPolynomial& left, const CPolynomial& right)
+{
+  return CPolyProduct(left, right);
+}
+
+// products of compound expressions need their operands materialized
+template <typename TLeft, typename TRight>
+CPolynomial operator*(const CPolyExpr<TLeft>& left, const CPolyExpr<TRight>& right)
+{
+  return CPolynomial(CPolynomial(left) * CPolynomial(right));
+}
+
+template <typename TLeft, typename TRight>
+CPolySum<TLeft, TRight> operator+(const CPolyExpr<TLeft>& left, const CPolyExpr<TRight>& right)
+{
+  return CPolySum<TLeft, TRight>(left.self(), right.self());
+}
+
+// temporaries are reused instead of being referenced
+inline CPolynomial operator*(CPolynomial&& poly, double factor)
+{
+  poly *= factor;
+  return move(poly);
+}
+
+inline CPolynomial operator*(CPolynomial&& left, const CPolynomial& right)
+{
+  left *= right;
+  return move(left);
+}
+
+template <typename TExpr>
+CPolynomial operator+(CPolynomial&& left, const CPolyExpr<TExpr>& right)
+{
+  left += right;
+  return move(left);
+}
+
+template <typename TExpr>
+CPolyScaled<TExpr> operator-(const CPolyExpr<TExpr>& expr)
+{
+  return CPolyScaled<TExpr>(expr.self(), -1.0);
+}
+
+template <typename TLeft, typename TRight>
+CPolySum<TLeft, CPolyScaled<TRight>> operator-(const CPolyExpr<TLeft>& left, const CPolyExpr<TRight>& right)
+{
+  return CPolySum<TLeft, CPolyScaled<TRight>>(left.self(), CPolyScaled<TRight>(right.self(), -1.0));
+}
+
+template <typename TExpr>
+CPolynomial operator-(CPolynomial&& left, const CPolyExpr<TExpr>& right)
+{
+  left -= right;
+  return move(left);
+}
+
+inline CPolynomial operator*(const CPolynomial& left, CPolynomial&& right)
+{
+  right *= left;
+  return move(right);
+}
+
+inline CPolynomial operator*(CPolynomial&& left, CPolynomial&& right)
+{
+  left *= right;
+  return move(left);
+}
+
+// mixed products would otherwise be ambiguous with the conversion to CPolynomial
+template <typename TExpr>
+CPolynomial operator*(const CPolyExpr<TExpr>& left, const CPolynomial& right)
+{
+  return CPolynomial(left) * right;
+}
+
+template <typename TExpr>
+CPolynomial operator*(const CPolynomial& left, const CPolyExpr<TExpr>& right)
+{
+  return left * CPolynomial(right);
+}
+
+template <typename TExpr>
+CPolynomial operator*(const CPolyExpr<TExpr>& left, CPolynomial&& right)
+{
+  return CPolynomial(left) * move(right);
+}
+
+template <typename TExpr>
+CPolynomial operator*(CPolynomial&& left, const CPolyExpr<TExpr>& right)
+{
+  return move(left) * CPolynomial(right);
+}
+
+template <typename TExpr>
+CPolynomial operator+(const CPolyExpr<TExpr>& left, CPolynomial&& right)
+{
+  right += left;
+  return move(right);
+}
+
+inline CPolynomial operator+(CPolynomial&& left, CPolynomial&& right)
+{
+  left += right;
+  return move(left);
 }
 
+template <typename TExpr>
+CPolynomial operator-(const CPolyExpr<TExpr>& left, CPolynomial&& right)
+{
+  right *= -1.0;
+  right += left;
+  return move(right);
+}
+
+inline CPolynomial operator-(CPolynomial&& left, CPolynomial&& right)
+{
+  left -= right;
+  return move(left);
+}
+
+inline CPolynomial operator-(CPolynomial&& poly)
+{
+  poly *= -1.0;
+  return move(poly);
+}
+
+template <typename TExpr>
+unsigned CPolyExpr<TExpr>::degree() const
+{
+  return CPolynomial(self()).degree();
+}
+
+template <typename TExpr>
+double CPolyExpr<TExpr>::operator()(double x) const
+{
+  return CPolynomial(self())(x);
+}
+
+template <typename TExpr>
+double CPolyExpr<TExpr>::operator[](int degree) const
+{
+  const CPolynomial value(self());
+  return value[degree];
+}
+
+template <typename TExpr>
+CPolyExpr<TExpr>::operator bool() const
+{
+  return bool(CPolynomial(self()));
+}
+
+template <typename TExpr>
+bool CPolyExpr<TExpr>::operator!() const
+{
+  return !CPolynomial(self());
+}
+
+template <typename TExpr>
+ostream& operator<<(ostream& os, const CPolyExpr<TExpr>& expr)
+{
+  return os << CPolynomial(expr);
+}
+
+template <typename TLeft, typename TRight>
+bool operator==(const CPolyExpr<TLeft>& left, const CPolyExpr<TRight>& right)
+{
+  return CPolynomial(left) == CPolynomial(right);
+}
+
+template <typename TLeft, typename TRight>
+bool operator!=(const CPolyExpr<TLeft>& left, const CPolyExpr<TRight>& right)
+{
+  return CPolynomial(left) != CPolynomial(right);
+}
+
+template <typename TExpr>
+bool operator==(const CPolynomial& left, const CPolyExpr<TExpr>& right)
+{
+  return left == CPolynomial(right);
+}
+
+template <typename TExpr>
+bool operator==(const CPolyExpr<TExpr>& left, const CPolynomial& right)
+{
+  return CPolynomial(left) == right;
+}
+
+template <typename TExpr>
+bool operator!=(const CPolynomial& left, const CPolyExpr<TExpr>& right)
+{
+  return left != CPolynomial(right);
+}
+
+template <typename TExpr>
+bool operator!=(const CPolyExpr<TExpr>& left, const CPolynomial& right)
+{
+  return CPolynomial(left) != right;
+}
+
+// Polynomial of degree at most N with its coefficients stored inline, for
+// hot loops over small fixed-degree polynomials (splines, filters). All
+// arithmetic is constexpr and evaluation is an unrolled Horner scheme.
+template <unsigned N>
+class CFixedPolynomial
+{
+  public:
+    constexpr CFixedPolynomial() : coefficients{} {}
+
+    // coefficients from x^0 upwards
+    constexpr CFixedPolynomial(initializer_list<double> init) : coefficients{}
+    {
+      assert(init.size() <= N + 1);
+      unsigned deg = 0;
+      for (double value : init) {
+        coefficients[deg++] = value;
+      }
+    }
+
+    // throws if poly does not fit into degree N
+    explicit CFixedPolynomial(const CPolynomial& poly) : coefficients{}
+    {
+      if (poly && poly.degree() > N) {
+        throw invalid_argument("polynomial degree exceeds CFixedPolynomial capacity");
+      }
+      for (unsigned deg = 0; deg <= N; ++deg) {
+        coefficients[deg] = poly[deg];
+      }
+    }
+
+    operator CPolynomial() const
+    {
+      return CPolynomial::fromVector(vector<double>(coefficients.begin(), coefficients.end()));
+    }
+
+    constexpr double& operator[](unsigned deg) { return coefficients[deg]; }
+    constexpr double operator[](unsigned deg) const { return coefficients[deg]; }
+
+    constexpr unsigned degree() const
+    {
+      for (unsigned deg = N; deg > 0; --deg) {
+        // fabs is not constexpr before C++23
+        if ((coefficients[deg] < 0 ? -coefficients[deg] : coefficients[deg]) > 1e-9) {
+          return deg;
+        }
+      }
+      return 0;
+    }
 
+    constexpr double operator()(double x) const
+    {
+      return horner(x, make_index_sequence<N + 1>());
+    }
+
+    constexpr CFixedPolynomial operator+(const CFixedPolynomial& other) const
+    {
+      CFixedPolynomial result;
+      for (unsigned deg = 0; deg <= N; ++deg) {
+        result.coefficients[deg] = coefficients[deg] + other.coefficients[deg];
+      }
+      return result;
+    }
+    constexpr CFixedPolynomial operator-(const CFixedPolynomial& other) const
+    {
+      return *this + other * -1.0;
+    }
+    constexpr CFixedPolynomial operator-() const
+    {
+      return *this * -1.0;
+    }
+    constexpr CFixedPolynomial operator*(double factor) const
+    {
+      CFixedPolynomial result;
+      for (unsigned deg = 0; deg <= N; ++deg) {
+        result.coefficients[deg] = coefficients[deg] * factor;
+      }
+      return result;
+    }
+    template <unsigned M>
+    constexpr CFixedPolynomial<N + M> operator*(const CFixedPolynomial<M>& other) const
+    {
+      CFixedPolynomial<N + M> result;
+      for (unsigned i = 0; i <= N; ++i) {
+        for (unsigned j = 0; j <= M; ++j) {
+          result[i + j] += coefficients[i] * other[j];
+        }
+      }
+      return result;
+    }
+
+    constexpr bool operator==(const CFixedPolynomial& other) const { return coefficients == other.coefficients; }
+    constexpr bool operator!=(const CFixedPolynomial& other) const { return !(*this == other); }
+
+  private:
+    array<double, N + 1> coefficients;
+
+    template <size_t... Degree>
+    constexpr double horner(double x, index_sequence<Degree...>) const
+    {
+      double result = 0.0;
+      ((result = result * x + coefficients[N - Degree]), ...);
+      return result;
+    }
 };
 
 #ifndef __PROGTEST__
@@ -292,6 +1558,225 @@ int main ()
   assert ( ! static_cast<bool> ( b ) );
   assert ( ! b );
 
+  a[4] = 2;
+  a[1] = -1;
+  b[1] = 1;
+  b[0] = 3;
+  c = a + b;
+  assert ( c . degree () == 4
+           && dumpMatch ( c, std::vector<double>{ 3.0, 0.0, 0.0, 0.0, 2.0 } ) );
+  out . str ("");
+  out << c;
+  assert ( out . str () == "2*x^4 + 3" );
+  c = a * b;
+  assert ( c . degree () == 5
+           && dumpMatch ( c, std::vector<double>{ 0.0, -3.0, -1.0, 0.0, 6.0, 2.0 } ) );
+
+  CPolynomial d, e;
+  for ( int i = 0; i <= 10; ++i )
+    d[i] = i + 1;
+  d *= 1;
+  assert ( d . isDense () );
+  e[1000] = 1;
+  e[0] = -1;
+  e *= 1;
+  assert ( ! e . isDense () );
+  c = d * e;
+  assert ( ! c . isDense () && c . degree () == 1010 && c[1000] == 1 && c[5] == -6 );
+  c = d * d;
+  assert ( c . isDense () && c . degree () == 20 && c[20] == 121 && c[0] == 1 );
+  c = d + e;
+  assert ( ! c . isDense () && c[0] == 0 && c[10] == 11 && c[1000] == 1 );
+  c[1000] = 0;
+  c *= 1;
+  assert ( c . isDense () && c . degree () == 10 );
+
+  std::vector<double> xs { -2.0, -1.0, -0.5, 0.0, 0.5, 1.0, 1.5, 2.0, 3.0 }, ys ( xs . size () );
+  d . evaluate ( xs, ys );
+  for ( size_t i = 0; i < xs . size (); ++i )
+    assert ( smallDiff ( ys[i], d ( xs[i] ) ) );
+  xs = { -1.0, -0.999, -0.5, 0.0, 0.5, 0.999, 1.0, 1.001 };
+  ys . resize ( xs . size () );
+  e . evaluate ( xs, ys );
+  for ( size_t i = 0; i < xs . size (); ++i )
+    assert ( smallDiff ( ys[i], pow ( xs[i], 1000 ) - 1 ) );
+  assert ( smallDiff ( d ( 2 ), 20481 ) );
+
+  c = d * e * -2 + d * 3;
+  assert ( c . degree () == 1010 && c[1000] == -2 && c[1010] == -22 && c[10] == 33 + 22 && c[0] == 5 );
+  c = c * 0.5 + c;
+  assert ( c[1000] == -3 && c[0] == 7.5 );
+  c += c;
+  assert ( c[1000] == -6 && c[0] == 15 );
+  c = CPolynomial ( d + d ) * d * 0.5;
+  assert ( c . degree () == 20 && c[20] == 121 && c[0] == 1 );
+  c = ( d + e ) * ( d + e );
+  assert ( c . degree () == 2000 && c[2000] == 1 && c[1010] == 22 );
+
+  c = CPolynomial ();
+  c[0] = 1;
+  c[2] = -1;
+  c[7] = 1.0 / 3;
+  out . str ("");
+  out << c;
+  assert ( out . str () == "0.333333*x^7 - x^2 + 1" );
+  std::string text;
+  c . format_to ( std::back_inserter ( text ) );
+  assert ( text == out . str () );
+
+  CPolynomial p, q, r, s;
+  p[3] = 1;
+  p[2] = -2;
+  p[0] = -4;
+  q[1] = 1;
+  q[0] = -3;
+  divmod ( p, q, s, r );
+  assert ( s . degree () == 2 && dumpMatch ( s, std::vector<double>{ 3.0, 1.0, 1.0 } ) );
+  assert ( r . degree () == 0 && smallDiff ( r[0], 5 ) );
+  assert ( p / q == s && p % q == r );
+  c = p - q * s - r;
+  assert ( ! c );
+  c = - p + p;
+  assert ( ! c );
+  c = p;
+  c -= q;
+  assert ( c[1] == -1 && c[0] == -1 && c[3] == 1 );
+  out . str ("");
+  out << q * s;
+  assert ( out . str () == "x^3 - 2*x^2 - 9" );
+  assert ( ( q * s ) . degree () == 3 && ( q * s ) [2] == -2 && ( q * 2 ) ( 3.0 ) == 0 );
+  assert ( q * s == s * q && ! ( p - p ) && p != q * s && q * s != p );
+  auto owned = ( p + q ) * ( q * s );
+  auto negated = - CPolynomial ( p ) + q;
+  static_assert ( std::is_same_v<decltype ( owned ), CPolynomial>
+                  && std::is_same_v<decltype ( negated ), CPolynomial> );
+  assert ( owned == ( p + q ) * s * q && negated == q - p );
+  try
+  {
+    p / CPolynomial ();
+    assert ( "missing exception" == nullptr );
+  }
+  catch ( const std::invalid_argument & )
+  {
+  }
+
+  p = CPolynomial ();
+  p[2] = 1;
+  p[1] = 1;
+  p[0] = -2;
+  q = CPolynomial ();
+  q[2] = 1;
+  q[1] = 2;
+  q[0] = -3;
+  c = gcd ( p * 3, q * -2 );
+  assert ( c . degree () == 1 && smallDiff ( c[1], 1 ) && smallDiff ( c[0], -1 ) );
+
+  CPolynomial big, divisor;
+  for ( int i = 0; i < 600; ++i )
+    big[i] = ( i % 7 ) - 3;
+  for ( int i = 0; i < 300; ++i )
+    divisor[i] = 1.0 / ( i + 1 );
+  divisor[300] = 1;
+  divmod ( big, divisor, s, r );
+  assert ( s . degree () == 299 && r . degree () < 300 );
+  c = big - ( divisor * s + r );
+  for ( int i = 0; i < 600; ++i )
+    assert ( fabs ( c[i] ) < 1e-6 );
+
+  xs = { -1.5, -1.0, 0.0, 0.25, 1.0, 2.0, 2.5 };
+  ys . resize ( xs . size () );
+  d . evaluateMultipoint ( xs, ys );
+  for ( size_t i = 0; i < xs . size (); ++i )
+    assert ( fabs ( ys[i] - d ( xs[i] ) ) < 1e-6 * std::max ( 1.0, fabs ( d ( xs[i] ) ) ) );
+  std::vector<double> points { 0.0, 1.0, 2.0, 3.0 }, samples ( points . size () );
+  p = CPolynomial ();
+  p[3] = 2;
+  p[1] = -1;
+  p[0] = 0.5;
+  p . evaluate ( points, samples );
+  c = CPolynomial::interpolate ( points, samples );
+  assert ( c . degree () == 3 && smallDiff ( c[3], 2 ) && smallDiff ( c[2], 0 )
+           && smallDiff ( c[1], -1 ) && smallDiff ( c[0], 0.5 ) );
+
+  constexpr CFixedPolynomial<2> f { 1.0, -3.0, 2.0 };
+  constexpr CFixedPolynomial<1> g { -1.0, 1.0 };
+  constexpr auto h = f * g - CFixedPolynomial<3> { 0.0, 0.0, 0.0, 2.0 };
+  static_assert ( f ( 2.0 ) == 3.0 && f . degree () == 2 );
+  static_assert ( h . degree () == 2 && h[2] == -5.0 && h[1] == 4.0 && h[0] == -1.0 );
+  c = h;
+  assert ( c . degree () == 2 && smallDiff ( c ( 3 ), -34 ) );
+  assert ( CFixedPolynomial<4> ( c ) ( 3 ) == h ( 3 ) );
+  try
+  {
+    CFixedPolynomial<1> tooSmall ( c );
+    assert ( "missing exception" == nullptr );
+  }
+  catch ( const std::invalid_argument & )
+  {
+  }
+
+  CPolynomial sparseA, sparseB;
+  for ( int i = 0; i < 1500; ++i )
+  {
+    sparseA[7 * i] = i % 3 + 1;
+    sparseB[5 * i] = 1 - i % 2;
+  }
+  c = sparseA * sparseB;
+  assert ( c . degree () == 7 * 1499 + 5 * 1498 );
+  bool sparseMatch = true;
+  for ( int k : { 0, 12, 35, 70, 5000, 7 * 1499 + 5 * 1498 } )
+  {
+    double expected = 0;
+    for ( int i = 0; i < 1500; ++i )
+      if ( k >= 7 * i && ( k - 7 * i ) % 5 == 0 && ( k - 7 * i ) / 5 < 1500 )
+        expected += sparseA[7 * i] * sparseB[( k - 7 * i )];
+    sparseMatch = sparseMatch && smallDiff ( c[k], expected );
+  }
+  assert ( sparseMatch );
+
+  // even terms only: the odd product terms are exact zeros, which the FFT
+  // has to reproduce, compared against Karatsuba on the split operand
+  for ( double scale : { 1.0, 0.37 } )
+  {
+    CPolynomial evenA, evenB, lowB, highB, shift;
+    for ( int i = 0; i < 700; i += 2 )
+      evenA[i] = scale * ( 2 * ( i % 9 ) - 9 );
+    for ( int i = 0; i < 600; i += 2 )
+      evenB[i] = scale * ( i % 7 + 1 );
+    for ( int i = 0; i < 400; i += 2 )
+      lowB[i] = evenB[i];
+    for ( int i = 400; i < 600; i += 2 )
+      highB[i - 400] = evenB[i];
+    shift[400] = 1;
+    // indexing keeps the sparse form, normalizing picks the dense one
+    evenA *= 1.0;
+    evenB *= 1.0;
+    lowB *= 1.0;
+    highB *= 1.0;
+    c = evenA * evenB;
+    d = evenA * lowB + evenA * highB * shift;
+    assert ( c . degree () == d . degree () );
+    bool match = true;
+    for ( unsigned i = 0; i <= c . degree (); ++i )
+      match = match && ( i % 2 ? c[i] == 0 : smallDiff ( c[i], d[i] ) );
+    assert ( match && ( scale != 1.0 || c == d ) );
+    out . str ("");
+    out << c;
+    assert ( out . str () . find ( "e-" ) == std::string::npos );
+  }
+
+  for ( int n : { 100, 2000 } )
+  {
+    CPolynomial ones;
+    for ( int i = 0; i < n; ++i )
+      ones[i] = 1;
+    ones *= 1.0;
+    c = ones * ones;
+    bool match = c . degree () == unsigned ( 2 * n - 2 );
+    for ( int i = 0; i <= 2 * n - 2; ++i )
+      match = match && smallDiff ( c[i], std::min ( i + 1, 2 * n - 1 - i ) );
+    assert ( match );
+  }
 
   return EXIT_SUCCESS;
 }
@@ -3,256 +3,2284 @@
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <iterator>
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <type_traits>
+#include <bit>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif /* __PROGTEST__ */
 using namespace std;
 
+// Bump allocator: strings placed here are never freed one by one, the whole
+// arena goes away with its owner.
+class CArena {
+  public:
+    CArena() : m_head(nullptr) {}
+    CArena(const CArena&) = delete;
+    CArena& operator=(const CArena&) = delete;
+    ~CArena() {
+      release();
+    }
+    char* allocate(size_t size) {
+      if (!m_head || m_head->m_used + size > m_head->m_capacity) {
+        size_t capacity = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+        TBlock* block = static_cast<TBlock*>(malloc(sizeof(TBlock) + capacity));
+        if (!block) {
+          throw std::bad_alloc();
+        }
+        block->m_next = m_head;
+        block->m_used = 0;
+        block->m_capacity = capacity;
+        m_head = block;
+      }
+      char* data = reinterpret_cast<char*>(m_head + 1) + m_head->m_used;
+      m_head->m_used += size;
+      return data;
+    }
+    void release() {
+      while (m_head) {
+        TBlock* next = m_head->m_next;
+        free(m_head);
+        m_head = next;
+      }
+    }
+  private:
+    struct TBlock {
+      TBlock* m_next;
+      size_t m_used;
+      size_t m_capacity;
+    };
+    static const size_t BLOCK_SIZE = 64 * 1024;
+    TBlock* m_head;
+};
+
+// Strings up to INLINE_CAPACITY characters are stored in the object itself,
+// longer ones on the heap or, when an arena is given, in the arena.
 class CString {
   public:
-    CString() : m_data(new char[1]), m_size(0) {
-      m_data[0] = '\0';
+    CString() {
+      m_buf[0] = '\0';
+      m_buf[TAG] = 0;
+    }
+    CString(const char* str, CArena* arena = nullptr) {
+      init(str, strlen(str), arena);
+    }
+    CString(const CString& other) {
+      init(other.c_str(), other.size(), nullptr);
+    }
+    CString(CString&& other) noexcept {
+      memcpy(m_buf, other.m_buf, sizeof(m_buf));
+      other.m_buf[0] = '\0';
+      other.m_buf[TAG] = 0;
+    }
+    CString& operator=(const CString& other) {
+      if (this != &other) {
+        CString copy(other);
+        *this = std::move(copy);
+      }
+      return *this;
+    }
+    CString& operator=(CString&& other) noexcept {
+      if (this != &other) {
+        release();
+        memcpy(m_buf, other.m_buf, sizeof(m_buf));
+        other.m_buf[0] = '\0';
+        other.m_buf[TAG] = 0;
+      }
+      return *this;
+    }
+    ~CString() {
+      release();
+    }
+    const char* c_str() const {
+      return isInline() ? m_buf : externalData();
+    }
+    size_t size() const {
+      if (isInline()) {
+        return m_buf[TAG];
+      }
+      size_t size;
+      memcpy(&size, m_buf + sizeof(char*), sizeof(size));
+      return size;
+    }
+    bool operator==(const CString& other) const {
+      return size() == other.size() && memcmp(c_str(), other.c_str(), size()) == 0;
+    }
+    bool operator!=(const CString& other) const {
+      return !(*this == other);
+    }
+    char& operator[](size_t index) {
+      return const_cast<char*>(c_str())[index];
+    }
+    const char& operator[](size_t index) const {
+      return c_str()[index];
+    }
+    friend std::ostream& operator<<(std::ostream& os, const CString& str) {
+      return os.write(str.c_str(), str.size());
+    }
+    bool operator<(const CString& other) const {
+      return strcmp(c_str(), other.c_str()) < 0;
+    }
+    bool operator>(const CString& other) const {
+      return strcmp(c_str(), other.c_str()) > 0;
+    }
+  private:
+    static const size_t INLINE_CAPACITY = 22;
+    static const size_t TAG = INLINE_CAPACITY + 1;
+    // tag byte: inline length, or one of these for external data
+    static const unsigned char HEAP = 0x80;
+    static const unsigned char ARENA = 0x81;
+
+    // inline: characters + '\0' in m_buf[0 .. 22], length in m_buf[TAG]
+    // external: data pointer and length at the start of m_buf
+    alignas(char*) char m_buf[INLINE_CAPACITY + 2];
+
+    bool isInline() const {
+      return (unsigned char)m_buf[TAG] <= INLINE_CAPACITY;
+    }
+    char* externalData() const {
+      char* data;
+      memcpy(&data, m_buf, sizeof(data));
+      return data;
+    }
+    void init(const char* str, size_t size, CArena* arena) {
+      if (size <= INLINE_CAPACITY) {
+        memcpy(m_buf, str, size);
+        m_buf[size] = '\0';
+        m_buf[TAG] = (char)size;
+        return;
+      }
+      char* data = arena ? arena->allocate(size + 1) : new char[size + 1];
+      memcpy(data, str, size);
+      data[size] = '\0';
+      memcpy(m_buf, &data, sizeof(data));
+      memcpy(m_buf + sizeof(data), &size, sizeof(size));
+      m_buf[TAG] = (char)(arena ? ARENA : HEAP);
+    }
+    void release() {
+      if ((unsigned char)m_buf[TAG] == HEAP) {
+        delete[] externalData();
+      }
+    }
+};
+
+// Deduplicating string store: every distinct string is kept once and is
+// identified by a stable 32-bit handle, equal strings get equal handles.
+// The strings sit in chunks of doubling size that never move, so get() of a
+// handle handed out earlier is safe while another thread keeps interning.
+class CStringPool {
+  public:
+    CStringPool() : m_chunks(), m_count(0), m_slots(nullptr), m_slotCount(0) {}
+    CStringPool(const CStringPool& other) : m_chunks(), m_count(0), m_slots(nullptr), m_slotCount(0) {
+      copyFrom(other);
+    }
+    CStringPool& operator=(const CStringPool& other) {
+      if (this != &other) {
+        clear();
+        copyFrom(other);
+      }
+      return *this;
+    }
+    ~CStringPool() {
+      clear();
+    }
+    uint32_t intern(const char* str) {
+      if ((m_count + 1) * 2 > m_slotCount) {
+        rehash(m_slotCount ? m_slotCount * 2 : 64);
+      }
+      size_t slot = probe(str, strlen(str));
+      if (m_slots[slot] != EMPTY) {
+        return m_slots[slot];
+      }
+      size_t chunk, offset;
+      locate(m_count, chunk, offset);
+      if (!m_chunks[chunk]) {
+        m_chunks[chunk] = new CString[FIRST_CHUNK << chunk];
+      }
+      m_chunks[chunk][offset] = CString(str, &m_arena);
+      m_slots[slot] = (uint32_t)m_count;
+      return (uint32_t)m_count++;
+    }
+    // like intern(), but never adds the string
+    bool find(const char* str, uint32_t& handle) const {
+      if (!m_slotCount) {
+        return false;
+      }
+      handle = m_slots[probe(str, strlen(str))];
+      return handle != EMPTY;
+    }
+    const CString& get(uint32_t handle) const {
+      size_t chunk, offset;
+      locate(handle, chunk, offset);
+      assert(m_chunks[chunk]);
+      return m_chunks[chunk][offset];
+    }
+    size_t size() const {
+      return m_count;
+    }
+    // FNV-1a
+    static size_t hash(const char* str, size_t len) {
+      uint64_t h = 14695981039346656037ull;
+      for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char)str[i]) * 1099511628211ull;
+      }
+      return (size_t)(h ^ (h >> 32));
+    }
+  private:
+    static const uint32_t EMPTY = UINT32_MAX;
+    static const size_t FIRST_CHUNK = 16;
+    // chunk k holds FIRST_CHUNK << k strings, enough for every 32-bit handle
+    static const size_t CHUNK_COUNT = 32;
+
+    CArena m_arena;
+    CString* m_chunks[CHUNK_COUNT];
+    size_t m_count;
+    // open addressing, linear probing; slots hold handles
+    uint32_t* m_slots;
+    size_t m_slotCount;
+
+    // slot holding the string, or the empty slot where it belongs
+    size_t probe(const char* str, size_t len) const {
+      size_t slot = hash(str, len) & (m_slotCount - 1);
+      while (m_slots[slot] != EMPTY) {
+        const CString& candidate = get(m_slots[slot]);
+        if (candidate.size() == len && memcmp(candidate.c_str(), str, len) == 0) {
+          break;
+        }
+        slot = (slot + 1) & (m_slotCount - 1);
+      }
+      return slot;
+    }
+    static void locate(size_t handle, size_t& chunk, size_t& offset) {
+      chunk = std::bit_width(handle / FIRST_CHUNK + 1) - 1;
+      offset = handle - FIRST_CHUNK * ((size_t(1) << chunk) - 1);
+    }
+    void rehash(size_t slotCount) {
+      delete[] m_slots;
+      m_slotCount = slotCount;
+      m_slots = new uint32_t[m_slotCount];
+      for (size_t i = 0; i < m_slotCount; ++i) {
+        m_slots[i] = EMPTY;
+      }
+      for (size_t handle = 0; handle < m_count; ++handle) {
+        const CString& str = get(handle);
+        size_t slot = hash(str.c_str(), str.size()) & (m_slotCount - 1);
+        while (m_slots[slot] != EMPTY) {
+          slot = (slot + 1) & (m_slotCount - 1);
+        }
+        m_slots[slot] = (uint32_t)handle;
+      }
+    }
+    void copyFrom(const CStringPool& other) {
+      for (size_t chunk = 0; chunk < CHUNK_COUNT && other.m_chunks[chunk]; ++chunk) {
+        m_chunks[chunk] = new CString[FIRST_CHUNK << chunk];
+      }
+      for (m_count = 0; m_count < other.m_count; ++m_count) {
+        size_t chunk, offset;
+        locate(m_count, chunk, offset);
+        m_chunks[chunk][offset] = CString(other.get(m_count).c_str(), &m_arena);
+      }
+      m_slotCount = other.m_slotCount;
+      m_slots = m_slotCount ? new uint32_t[m_slotCount] : nullptr;
+      if (m_slotCount) {
+        memcpy(m_slots, other.m_slots, m_slotCount * sizeof(*m_slots));
+      }
+    }
+    void clear() {
+      for (size_t chunk = 0; chunk < CHUNK_COUNT; ++chunk) {
+        delete[] m_chunks[chunk];
+        m_chunks[chunk] = nullptr;
+      }
+      delete[] m_slots;
+      m_slots = nullptr;
+      m_count = m_slotCount = 0;
+      m_arena.release();
+    }
+};
+
+// Packed forms of the keys: an ID "123456/7890" becomes the number
+// 1234567890 and a date "YYYY-MM-DD" the count of days since 0000-01-01, so
+// the index compares machine words. Anything else is kept as a pool handle
+// with a flag bit set; such keys sort after all canonical ones.
+class CKeyCodec {
+  public:
+    static const uint64_t ID_TEXT = 1ull << 63;
+    static const uint32_t DATE_TEXT = 1u << 31;
+    static const size_t ID_LENGTH = 11;
+    static const size_t DATE_LENGTH = 10;
+
+    static bool parseId(const char* str, uint64_t& id) {
+      id = 0;
+      for (size_t i = 0; i < ID_LENGTH; ++i) {
+        if (i == 6) {
+          if (str[i] != '/') {
+            return false;
+          }
+        } else if (str[i] >= '0' && str[i] <= '9') {
+          id = id * 10 + (str[i] - '0');
+        } else {
+          return false;
+        }
+      }
+      return str[ID_LENGTH] == '\0';
+    }
+    // out must hold ID_LENGTH + 1 characters
+    static void formatId(uint64_t id, char* out) {
+      out[ID_LENGTH] = '\0';
+      for (size_t i = ID_LENGTH; i-- > 0;) {
+        if (i == 6) {
+          out[i] = '/';
+        } else {
+          out[i] = (char)('0' + id % 10);
+          id /= 10;
+        }
+      }
+    }
+    static bool parseDate(const char* str, uint32_t& date) {
+      int fields[3] = {0, 0, 0};
+      static const size_t widths[3] = {4, 2, 2};
+      for (size_t field = 0, pos = 0; field < 3; ++field) {
+        for (size_t i = 0; i < widths[field]; ++i, ++pos) {
+          if (str[pos] < '0' || str[pos] > '9') {
+            return false;
+          }
+          fields[field] = fields[field] * 10 + (str[pos] - '0');
+        }
+        if (str[pos++] != (field < 2 ? '-' : '\0')) {
+          return false;
+        }
+      }
+      int year = fields[0], month = fields[1], day = fields[2];
+      if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month)) {
+        return false;
+      }
+      date = (uint32_t)(daysFromCivil(year, month, day) - daysFromCivil(0, 1, 1));
+      return true;
     }
-    CString(const char* str) : m_size(strlen(str)) {
-      m_data = new char[m_size + 1];
-      strcpy(m_data, str);
+    // out must hold DATE_LENGTH + 1 characters
+    static void formatDate(uint32_t date, char* out) {
+      int year, month, day;
+      civilFromDays((int64_t)date + daysFromCivil(0, 1, 1), year, month, day);
+      writeDigits(out, year, 4);
+      out[4] = '-';
+      writeDigits(out + 5, month, 2);
+      out[7] = '-';
+      writeDigits(out + 8, day, 2);
+      out[DATE_LENGTH] = '\0';
     }
-    CString(const CString& other) : m_size(other.m_size) {
-      m_data = new char[m_size + 1];
-      strcpy(m_data, other.m_data);
+  private:
+    static void writeDigits(char* out, int value, size_t width) {
+      for (size_t i = width; i-- > 0; value /= 10) {
+        out[i] = (char)('0' + value % 10);
+      }
+    }
+    static int daysInMonth(int year, int month) {
+      static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+      bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+      return month == 2 && leap ? 29 : days[month - 1];
+    }
+    // proleptic Gregorian calendar, day 0 is 1970-01-01
+    static int64_t daysFromCivil(int64_t year, int month, int day) {
+      year -= month <= 2;
+      int64_t era = (year >= 0 ? year : year - 399) / 400;
+      int64_t yoe = year - era * 400;
+      int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+      int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      return era * 146097 + doe - 719468;
+    }
+    static void civilFromDays(int64_t days, int& year, int& month, int& day) {
+      days += 719468;
+      int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+      int64_t doe = days - era * 146097;
+      int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      int64_t mp = (5 * doy + 2) / 153;
+      day = (int)(doy - (153 * mp + 2) / 5 + 1);
+      month = (int)(mp < 10 ? mp + 3 : mp - 9);
+      year = (int)(yoe + era * 400 + (month <= 2));
     }
-    CString(CString&& other) noexcept : m_data(other.m_data), m_size(other.m_size) {
+};
+
+// ID and date in the CKeyCodec form, the rest as string pool handles
+struct TPerson {
+  uint64_t m_Id;
+  uint32_t m_Date;
+  uint32_t m_Name;
+  uint32_t m_Surname;
+  uint32_t m_Street;
+  uint32_t m_City;
+};
+
+// Types whose objects may be moved to another address by copying their
+// bytes, leaving nothing to destroy at the old one.
+template <class T>
+struct TRelocatable {
+  static const bool value = std::is_trivially_copyable<T>::value;
+};
+// a CString holds no pointer into itself
+template <>
+struct TRelocatable<CString> {
+  static const bool value = true;
+};
+
+// Growable array over raw storage: only the first size() slots hold
+// objects, growth moves them without constructing the spare capacity.
+template <class T>
+class Vector {
+  public:
+    using value_type = T;
+    Vector() : m_capacity(0), m_size(0), m_data(nullptr) {}
+    Vector(const Vector& other) : m_capacity(0), m_size(0), m_data(nullptr) {
+      reserve(other.m_size);
+      std::uninitialized_copy(other.m_data, other.m_data + other.m_size, m_data);
+      m_size = other.m_size;
+    }
+    Vector(Vector&& other) noexcept : m_capacity(other.m_capacity), m_size(other.m_size), m_data(other.m_data) {
       other.m_data = nullptr;
+      other.m_capacity = 0;
       other.m_size = 0;
     }
-    CString& operator=(const CString& other) {
+    Vector& operator=(const Vector& other) {
+      if (this != &other) {
+        Vector copy(other);
+        *this = std::move(copy);
+      }
+      return *this;
+    }
+    Vector& operator=(Vector&& other) noexcept {
       if (this != &other) {
-        delete[] m_data;
+        clear();
+        ::operator delete(m_data);
+        m_data = other.m_data;
+        m_capacity = other.m_capacity;
         m_size = other.m_size;
-        m_data = new char[m_size + 1];
-        memcpy(m_data, other.m_data, m_size + 1);
+        other.m_data = nullptr;
+        other.m_capacity = 0;
+        other.m_size = 0;
+      }
+      return *this;
+    }
+    ~Vector() {
+      clear();
+      ::operator delete(m_data);
+    }
+    void reserve(size_t capacity) {
+      if (capacity > m_capacity) {
+        relocate(allocate(capacity), capacity);
+      }
+    }
+    void push_back(const value_type& value) {
+      emplace_back(value);
+    }
+    void push_back(value_type&& value) {
+      emplace_back(std::move(value));
+    }
+    template <class... TArgs>
+    value_type& emplace_back(TArgs&&... args) {
+      if (m_size < m_capacity) {
+        new (m_data + m_size) value_type(std::forward<TArgs>(args)...);
+      } else {
+        // build the new element first, args may refer to an old one
+        size_t capacity = m_capacity ? m_capacity * 2 : 4;
+        value_type* data = allocate(capacity);
+        new (data + m_size) value_type(std::forward<TArgs>(args)...);
+        relocate(data, capacity);
+      }
+      return m_data[m_size++];
+    }
+    void pop_back() {
+      assert(m_size > 0);
+      m_data[--m_size].~value_type();
+    }
+    void clear() {
+      std::destroy(m_data, m_data + m_size);
+      m_size = 0;
+    }
+    size_t size() const {
+      return m_size;
+    }
+    size_t capacity() const {
+      return m_capacity;
+    }
+    value_type* data() {
+      return m_data;
+    }
+    const value_type* data() const {
+      return m_data;
+    }
+    value_type& operator[](size_t index) {
+      return m_data[index];
+    }
+    const value_type& operator[](size_t index) const {
+      return m_data[index];
+    }
+    value_type& at(size_t index) {
+      assert(index < size());
+      return m_data[index];
+    }
+    const value_type& at(size_t index) const {
+      assert(index < size());
+      return m_data[index];
+    }
+    value_type* begin() {
+      return m_data;
+    }
+    value_type* end() {
+      return m_data + m_size;
+    }
+    const value_type* begin() const {
+      return m_data;
+    }
+    const value_type* end() const {
+      return m_data + m_size;
+    }
+  private:
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "over-aligned element type");
+    size_t m_capacity;
+    size_t m_size;
+    value_type* m_data;
+
+    static value_type* allocate(size_t capacity) {
+      return static_cast<value_type*>(::operator new(capacity * sizeof(value_type)));
+    }
+    // moves the elements into data and makes it the storage
+    void relocate(value_type* data, size_t capacity) {
+      if constexpr (TRelocatable<T>::value) {
+        if (m_size) {
+          memcpy(static_cast<void*>(data), static_cast<const void*>(m_data), m_size * sizeof(value_type));
+        }
+      } else {
+        std::uninitialized_move(m_data, m_data + m_size, data);
+        std::destroy(m_data, m_data + m_size);
+      }
+      ::operator delete(m_data);
+      m_data = data;
+      m_capacity = capacity;
+    }
+};
+
+// B+tree over values ordered by TLess; all values live in the leaves, inner
+// nodes keep a copy of the smallest value of each right subtree as separator.
+// Nodes are reference counted and shared between copies of the tree, an
+// insert copies only the nodes on its path that are still shared.
+template <class T, class TLess, size_t CAPACITY = 32>
+class CBTree {
+  private:
+    struct TNode {
+      bool m_leaf;
+      size_t m_count;
+      size_t m_refs;
+    };
+    // one spare slot so that a node may overflow before it is split
+    struct TLeaf : TNode {
+      T m_values[CAPACITY + 1];
+    };
+    struct TInner : TNode {
+      T m_keys[CAPACITY + 1];
+      TNode* m_children[CAPACITY + 2];
+    };
+    static const size_t MAX_DEPTH = 16;
+  public:
+    // Forward iterator over the leaves; keeps the path from the root because
+    // the leaves are not linked to each other.
+    class CCursor {
+      public:
+        CCursor() : m_depth(0), m_leaf(nullptr), m_pos(0) {}
+        bool valid() const {
+          return m_leaf != nullptr;
+        }
+        const T& operator*() const {
+          return m_leaf->m_values[m_pos];
+        }
+        const T* operator->() const {
+          return &m_leaf->m_values[m_pos];
+        }
+        void next() {
+          if (++m_pos < m_leaf->m_count) {
+            return;
+          }
+          skipExhausted();
+        }
+      private:
+        friend class CBTree;
+
+        const TInner* m_path[MAX_DEPTH];
+        size_t m_index[MAX_DEPTH];
+        size_t m_depth;
+        const TLeaf* m_leaf;
+        size_t m_pos;
+
+        void descend(const TNode* node) {
+          while (!node->m_leaf) {
+            const TInner* inner = static_cast<const TInner*>(node);
+            m_path[m_depth] = inner;
+            m_index[m_depth++] = 0;
+            node = inner->m_children[0];
+          }
+          m_leaf = static_cast<const TLeaf*>(node);
+          m_pos = 0;
+        }
+        void descendLast(const TNode* node) {
+          while (!node->m_leaf) {
+            const TInner* inner = static_cast<const TInner*>(node);
+            m_path[m_depth] = inner;
+            m_index[m_depth++] = inner->m_count;
+            node = inner->m_children[inner->m_count];
+          }
+          m_leaf = static_cast<const TLeaf*>(node);
+          m_pos = m_leaf->m_count - 1;
+        }
+        // steps to the last value of the previous leaf
+        void previousLeaf() {
+          while (m_depth > 0 && m_index[m_depth - 1] == 0) {
+            --m_depth;
+          }
+          if (m_depth == 0) {
+            m_leaf = nullptr;
+            return;
+          }
+          const TInner* inner = m_path[m_depth - 1];
+          descendLast(inner->m_children[--m_index[m_depth - 1]]);
+        }
+        void skipExhausted() {
+          while (m_pos == m_leaf->m_count) {
+            while (m_depth > 0 && m_index[m_depth - 1] == m_path[m_depth - 1]->m_count) {
+              --m_depth;
+            }
+            if (m_depth == 0) {
+              m_leaf = nullptr;
+              return;
+            }
+            const TInner* inner = m_path[m_depth - 1];
+            descend(inner->m_children[++m_index[m_depth - 1]]);
+          }
+        }
+    };
+
+    CBTree() : m_root(nullptr), m_size(0) {}
+    CBTree(const CBTree& other) : m_root(retain(other.m_root)), m_size(other.m_size) {}
+    CBTree& operator=(const CBTree& other) {
+      if (this != &other) {
+        TNode* root = retain(other.m_root);
+        release(m_root);
+        m_root = root;
+        m_size = other.m_size;
+      }
+      return *this;
+    }
+    ~CBTree() {
+      release(m_root);
+    }
+    size_t size() const {
+      return m_size;
+    }
+    // true if an equivalent value is present
+    bool contains(const T& probe) const {
+      if (!m_root) {
+        return false;
+      }
+      const TNode* node = m_root;
+      while (!node->m_leaf) {
+        const TInner* inner = static_cast<const TInner*>(node);
+        node = inner->m_children[upperBound(inner->m_keys, inner->m_count, probe)];
+      }
+      const TLeaf* leaf = static_cast<const TLeaf*>(node);
+      size_t pos = lowerBound(leaf->m_values, leaf->m_count, probe);
+      return pos < leaf->m_count && !TLess()(probe, leaf->m_values[pos]);
+    }
+    // false if an equivalent value is already present; a rejected insert
+    // copies none of the shared nodes on its path
+    bool insert(T&& value) {
+      if (contains(value)) {
+        return false;
+      }
+      m_root = m_root ? unshare(m_root) : newLeaf();
+      T separator;
+      TNode* sibling = nullptr;
+      insertInto(m_root, value, separator, sibling);
+      if (sibling) {
+        TInner* root = newInner();
+        root->m_count = 1;
+        root->m_keys[0] = std::move(separator);
+        root->m_children[0] = m_root;
+        root->m_children[1] = sibling;
+        m_root = root;
+      }
+      ++m_size;
+      return true;
+    }
+    // cursor at the first value not less than probe
+    CCursor lowerBound(const T& probe) const {
+      CCursor cursor;
+      if (!m_root) {
+        return cursor;
+      }
+      const TNode* node = m_root;
+      while (!node->m_leaf) {
+        const TInner* inner = static_cast<const TInner*>(node);
+        size_t idx = upperBound(inner->m_keys, inner->m_count, probe);
+        assert(cursor.m_depth < MAX_DEPTH);
+        cursor.m_path[cursor.m_depth] = inner;
+        cursor.m_index[cursor.m_depth++] = idx;
+        node = inner->m_children[idx];
+      }
+      cursor.m_leaf = static_cast<const TLeaf*>(node);
+      cursor.m_pos = lowerBound(cursor.m_leaf->m_values, cursor.m_leaf->m_count, probe);
+      cursor.skipExhausted();
+      return cursor;
+    }
+    // replaces the contents by count values that are sorted and unique,
+    // building the tree bottom up with full nodes
+    void assign(const T* values, size_t count) {
+      release(m_root);
+      m_root = nullptr;
+      m_size = count;
+      if (!count) {
+        return;
+      }
+      size_t nodeCount = (count + CAPACITY - 1) / CAPACITY;
+      TNode** nodes = new TNode*[nodeCount];
+      T* mins = new T[nodeCount];
+      for (size_t i = 0, pos = 0; i < nodeCount; ++i) {
+        TLeaf* leaf = newLeaf();
+        // spread the remainder so that no node is left nearly empty
+        leaf->m_count = count / nodeCount + (i < count % nodeCount);
+        for (size_t j = 0; j < leaf->m_count; ++j) {
+          leaf->m_values[j] = values[pos++];
+        }
+        nodes[i] = leaf;
+        mins[i] = leaf->m_values[0];
+      }
+      while (nodeCount > 1) {
+        size_t parentCount = (nodeCount + CAPACITY) / (CAPACITY + 1);
+        for (size_t i = 0, pos = 0; i < parentCount; ++i) {
+          TInner* inner = newInner();
+          size_t children = nodeCount / parentCount + (i < nodeCount % parentCount);
+          inner->m_count = children - 1;
+          for (size_t j = 0; j < children; ++j) {
+            inner->m_children[j] = nodes[pos + j];
+            if (j) {
+              inner->m_keys[j - 1] = mins[pos + j];
+            }
+          }
+          nodes[i] = inner;
+          mins[i] = mins[pos];
+          pos += children;
+        }
+        nodeCount = parentCount;
+      }
+      m_root = nodes[0];
+      delete[] nodes;
+      delete[] mins;
+    }
+    // cursor at the last value not greater than probe
+    CCursor floor(const T& probe) const {
+      CCursor cursor;
+      if (!m_root) {
+        return cursor;
+      }
+      const TNode* node = m_root;
+      while (!node->m_leaf) {
+        const TInner* inner = static_cast<const TInner*>(node);
+        size_t idx = upperBound(inner->m_keys, inner->m_count, probe);
+        assert(cursor.m_depth < MAX_DEPTH);
+        cursor.m_path[cursor.m_depth] = inner;
+        cursor.m_index[cursor.m_depth++] = idx;
+        node = inner->m_children[idx];
+      }
+      cursor.m_leaf = static_cast<const TLeaf*>(node);
+      size_t pos = upperBound(cursor.m_leaf->m_values, cursor.m_leaf->m_count, probe);
+      if (pos > 0) {
+        cursor.m_pos = pos - 1;
+      } else {
+        cursor.previousLeaf();
+      }
+      return cursor;
+    }
+    CCursor begin() const {
+      CCursor cursor;
+      if (m_root) {
+        cursor.descend(m_root);
+        cursor.skipExhausted();
+      }
+      return cursor;
+    }
+  private:
+    TNode* m_root;
+    size_t m_size;
+
+    static size_t lowerBound(const T* values, size_t count, const T& probe) {
+      size_t left = 0, right = count;
+      while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (TLess()(values[mid], probe)) {
+          left = mid + 1;
+        } else {
+          right = mid;
+        }
+      }
+      return left;
+    }
+    static size_t upperBound(const T* values, size_t count, const T& probe) {
+      size_t left = 0, right = count;
+      while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (TLess()(probe, values[mid])) {
+          right = mid;
+        } else {
+          left = mid + 1;
+        }
+      }
+      return left;
+    }
+    // value must not be present yet; on overflow the node is split, its new
+    // right half returned in sibling and the smallest value of that half in
+    // separator
+    static void insertInto(TNode* node, T& value, T& separator, TNode*& sibling) {
+      if (node->m_leaf) {
+        TLeaf* leaf = static_cast<TLeaf*>(node);
+        size_t pos = lowerBound(leaf->m_values, leaf->m_count, value);
+        for (size_t i = leaf->m_count; i > pos; --i) {
+          leaf->m_values[i] = std::move(leaf->m_values[i - 1]);
+        }
+        leaf->m_values[pos] = std::move(value);
+        if (++leaf->m_count > CAPACITY) {
+          TLeaf* right = newLeaf();
+          size_t half = leaf->m_count / 2;
+          right->m_count = leaf->m_count - half;
+          for (size_t i = 0; i < right->m_count; ++i) {
+            right->m_values[i] = std::move(leaf->m_values[half + i]);
+          }
+          leaf->m_count = half;
+          separator = right->m_values[0];
+          sibling = right;
+        }
+        return;
+      }
+      TInner* inner = static_cast<TInner*>(node);
+      size_t idx = upperBound(inner->m_keys, inner->m_count, value);
+      T childSeparator;
+      TNode* childSibling = nullptr;
+      inner->m_children[idx] = unshare(inner->m_children[idx]);
+      insertInto(inner->m_children[idx], value, childSeparator, childSibling);
+      if (!childSibling) {
+        return;
+      }
+      for (size_t i = inner->m_count; i > idx; --i) {
+        inner->m_keys[i] = std::move(inner->m_keys[i - 1]);
+        inner->m_children[i + 1] = inner->m_children[i];
+      }
+      inner->m_keys[idx] = std::move(childSeparator);
+      inner->m_children[idx + 1] = childSibling;
+      if (++inner->m_count > CAPACITY) {
+        TInner* right = newInner();
+        size_t mid = inner->m_count / 2;
+        right->m_count = inner->m_count - mid - 1;
+        for (size_t i = 0; i < right->m_count; ++i) {
+          right->m_keys[i] = std::move(inner->m_keys[mid + 1 + i]);
+        }
+        for (size_t i = 0; i <= right->m_count; ++i) {
+          right->m_children[i] = inner->m_children[mid + 1 + i];
+        }
+        separator = std::move(inner->m_keys[mid]);
+        inner->m_count = mid;
+        sibling = right;
+      }
+    }
+    static TLeaf* newLeaf() {
+      TLeaf* leaf = new TLeaf();
+      leaf->m_leaf = true;
+      leaf->m_count = 0;
+      leaf->m_refs = 1;
+      return leaf;
+    }
+    static TInner* newInner() {
+      TInner* inner = new TInner();
+      inner->m_leaf = false;
+      inner->m_count = 0;
+      inner->m_refs = 1;
+      return inner;
+    }
+    static TNode* retain(TNode* node) {
+      if (node) {
+        ++node->m_refs;
+      }
+      return node;
+    }
+    static void release(TNode* node) {
+      if (!node || --node->m_refs > 0) {
+        return;
+      }
+      if (node->m_leaf) {
+        delete static_cast<TLeaf*>(node);
+        return;
+      }
+      TInner* inner = static_cast<TInner*>(node);
+      for (size_t i = 0; i <= inner->m_count; ++i) {
+        release(inner->m_children[i]);
+      }
+      delete inner;
+    }
+    // private copy of a node about to be modified; its children stay shared
+    static TNode* unshare(TNode* node) {
+      if (node->m_refs == 1) {
+        return node;
+      }
+      TNode* copy;
+      if (node->m_leaf) {
+        const TLeaf* leaf = static_cast<const TLeaf*>(node);
+        TLeaf* leafCopy = newLeaf();
+        for (size_t i = 0; i < leaf->m_count; ++i) {
+          leafCopy->m_values[i] = leaf->m_values[i];
+        }
+        copy = leafCopy;
+      } else {
+        const TInner* inner = static_cast<const TInner*>(node);
+        TInner* innerCopy = newInner();
+        for (size_t i = 0; i < inner->m_count; ++i) {
+          innerCopy->m_keys[i] = inner->m_keys[i];
+        }
+        for (size_t i = 0; i <= inner->m_count; ++i) {
+          innerCopy->m_children[i] = retain(inner->m_children[i]);
+        }
+        copy = innerCopy;
+      }
+      copy->m_count = node->m_count;
+      --node->m_refs;
+      return copy;
+    }
+};
+
+// one input row of CRegister::bulkLoad()
+struct TRecord {
+  const char* m_Id;
+  const char* m_Name;
+  const char* m_Surname;
+  const char* m_Date;
+  const char* m_Street;
+  const char* m_City;
+};
+
+// records of one person are adjacent, ordered by date
+struct TPersonLess {
+  bool operator()(const TPerson& a, const TPerson& b) const {
+    return a.m_Id < b.m_Id || (a.m_Id == b.m_Id && a.m_Date < b.m_Date);
+  }
+};
+
+// entry of a secondary index: a string handle and the record having it
+struct TPosting {
+  uint32_t m_Value;
+  uint32_t m_Date;
+  uint64_t m_Id;
+};
+
+// postings of one value are adjacent and ordered by ID, then date
+struct TPostingLess {
+  bool operator()(const TPosting& a, const TPosting& b) const {
+    if (a.m_Value != b.m_Value) {
+      return a.m_Value < b.m_Value;
+    }
+    return a.m_Id < b.m_Id || (a.m_Id == b.m_Id && a.m_Date < b.m_Date);
+  }
+};
+
+// postings of one value are adjacent and ordered by date, then ID
+struct TPostingByDateLess {
+  bool operator()(const TPosting& a, const TPosting& b) const {
+    if (a.m_Value != b.m_Value) {
+      return a.m_Value < b.m_Value;
+    }
+    return a.m_Date < b.m_Date || (a.m_Date == b.m_Date && a.m_Id < b.m_Id);
+  }
+};
+
+class CRegister {
+    using TIndex = CBTree<TPerson, TPersonLess>;
+    using TPostings = CBTree<TPosting, TPostingLess>;
+    using TMoves = CBTree<TPosting, TPostingByDateLess>;
+  public:
+    CRegister() : m_storage(new TStorage()), db() {}
+    ~CRegister() {
+      // the records may point into the storage, drop them first
+      db = TIndex();
+      releaseStorage();
+    }
+    // copies share the storage and all index nodes until one of them changes
+    CRegister(const CRegister& other)
+      : m_storage(other.m_storage), db(other.db), m_byCity(other.m_byCity), m_byStreet(other.m_byStreet), m_bySurname(other.m_bySurname),
+        m_moves(other.m_moves) {
+      ++m_storage->m_refs;
+    }
+    CRegister& operator=(const CRegister& other) {
+      if (this != &other) {
+        db = other.db;
+        m_byCity = other.m_byCity;
+        m_byStreet = other.m_byStreet;
+        m_bySurname = other.m_bySurname;
+        m_moves = other.m_moves;
+        ++other.m_storage->m_refs;
+        releaseStorage();
+        m_storage = other.m_storage;
+      }
+      return *this;
+    }
+    bool add(const char id[], const char name[], const char surname[], const char date[], const char street[], const char city[]) {
+      uint64_t key;
+      if (lookupId(id, key) && find(key).valid()) {
+        return false;
+      }
+      CStringPool& pool = m_storage->m_pool;
+      TPerson person{internId(id), internDate(date), pool.intern(name), pool.intern(surname),
+                     pool.intern(street), pool.intern(city)};
+      if (!db.insert(TPerson(person))) {
+        return false;
+      }
+      m_bySurname.insert(TPosting{person.m_Surname, 0, person.m_Id});
+      indexAddress(person);
+      return true;
+    }
+    bool resettle(const char id[], const char date[], const char street[], const char city[]) {
+      uint64_t key;
+      if (!lookupId(id, key)) {
+        return false;
+      }
+      TIndex::CCursor first = find(key);
+      if (!first.valid()) {
+        return false;
+      }
+      // a date that was never interned cannot repeat an (id, date) pair;
+      // the strings are interned only for a move that is accepted
+      uint32_t when;
+      if (lookupDate(date, when) && db.contains(TPerson{key, when, 0, 0, 0, 0})) {
+        return false;
+      }
+      CStringPool& pool = m_storage->m_pool;
+      TPerson person{key, internDate(date), first->m_Name, first->m_Surname,
+                     pool.intern(street), pool.intern(city)};
+      db.insert(TPerson(person));
+      indexAddress(person);
+      return true;
+    }
+    // Loads a batch as if the rows were applied in order: a row with an
+    // unknown ID adds the person, a row with a known ID and the same name
+    // and surname moves them. Rows with a known ID but another name, or
+    // with an (id, date) pair already present, are rejected. Returns the
+    // number of accepted rows. Sorting runs on up to threads threads.
+    size_t bulkLoad(const TRecord* records, size_t count, unsigned threads = 1) {
+      Vector<TBatchEntry> batch;
+      batch.reserve(count);
+      CStringPool& pool = m_storage->m_pool;
+      for (size_t i = 0; i < count; ++i) {
+        const TRecord& record = records[i];
+        batch.push_back(TBatchEntry{TPerson{internId(record.m_Id), internDate(record.m_Date), pool.intern(record.m_Name),
+                                            pool.intern(record.m_Surname), pool.intern(record.m_Street), pool.intern(record.m_City)}, i});
+      }
+      parallelSort(batch.data(), count, threads ? threads : 1);
+
+      Vector<TPerson> merged;
+      merged.reserve(db.size() + count);
+      size_t accepted = 0;
+      TIndex::CCursor cursor = db.begin();
+      for (size_t i = 0; cursor.valid() || i < count;) {
+        uint64_t id = !cursor.valid() || (i < count && batch[i].m_Person.m_Id < cursor->m_Id) ? batch[i].m_Person.m_Id : cursor->m_Id;
+        size_t end = i;
+        while (end < count && batch[end].m_Person.m_Id == id) {
+          ++end;
+        }
+        // the name comes from the register, or else from the earliest row
+        const TPerson* owner = nullptr;
+        if (cursor.valid() && cursor->m_Id == id) {
+          owner = &*cursor;
+        } else {
+          size_t first = i;
+          for (size_t j = i + 1; j < end; ++j) {
+            if (batch[j].m_Order < batch[first].m_Order) {
+              first = j;
+            }
+          }
+          owner = &batch[first].m_Person;
+        }
+        uint32_t name = owner->m_Name, surname = owner->m_Surname;
+        while ((cursor.valid() && cursor->m_Id == id) || i < end) {
+          bool existing = cursor.valid() && cursor->m_Id == id;
+          if (i < end && (!existing || batch[i].m_Person.m_Date < cursor->m_Date)) {
+            const TPerson& person = batch[i++].m_Person;
+            bool duplicate = merged.size() && merged[merged.size() - 1].m_Id == id && merged[merged.size() - 1].m_Date == person.m_Date;
+            if (!duplicate && person.m_Name == name && person.m_Surname == surname) {
+              merged.push_back(person);
+              ++accepted;
+            }
+          } else if (i < end && batch[i].m_Person.m_Date == cursor->m_Date) {
+            ++i;
+          } else {
+            merged.push_back(*cursor);
+            cursor.next();
+          }
+        }
+      }
+      db.assign(merged.data(), merged.size());
+      rebuildPostings(merged);
+      return accepted;
+    }
+    // Everyone whose address at date passes all given filters, nullptr
+    // leaves a filter out and a null date means the latest address. Writes
+    // "id name surname" lines in ID order and returns their count.
+    size_t residents(std::ostream& os, const char city[], const char street[] = nullptr, const char surname[] = nullptr,
+                     const char date[] = nullptr) const {
+      const CStringPool& pool = m_storage->m_pool;
+      uint32_t when = UINT32_MAX;
+      if (date && !lookupDate(date, when)) {
+        return 0;
+      }
+      // one postings list per filter, walked in ID order
+      const TPostings* lists[3];
+      uint32_t values[3];
+      const char* filters[3] = {city, street, surname};
+      const TPostings* trees[3] = {&m_byCity, &m_byStreet, &m_bySurname};
+      size_t count = 0;
+      for (size_t i = 0; i < 3; ++i) {
+        if (!filters[i]) {
+          continue;
+        }
+        if (!pool.find(filters[i], values[count])) {
+          return 0;
+        }
+        lists[count++] = trees[i];
+      }
+      if (!count) {
+        return 0;
+      }
+      size_t found = 0;
+      uint64_t target = 0;
+      for (;;) {
+        // leapfrog: seek every list to the target until they all agree
+        for (size_t i = 0, agreed = 0; agreed < count; i = (i + 1) % count) {
+          TPostings::CCursor cursor = lists[i]->lowerBound(TPosting{values[i], 0, target});
+          if (!cursor.valid() || cursor->m_Value != values[i]) {
+            return found;
+          }
+          if (cursor->m_Id == target) {
+            ++agreed;
+          } else {
+            target = cursor->m_Id;
+            agreed = 1;
+          }
+        }
+        // the lists only say the person lived there at some point
+        TIndex::CCursor at = db.floor(TPerson{target, when, 0, 0, 0, 0});
+        if (at.valid() && at->m_Id == target && (!city || at->m_City == values[0])
+            && (!street || at->m_Street == values[city ? 1 : 0]) && (!surname || at->m_Surname == values[count - 1])) {
+          writeId(os, target);
+          os << " " << pool.get(at->m_Name) << " " << pool.get(at->m_Surname) << "\n";
+          ++found;
+        }
+        if (target == UINT64_MAX) {
+          return found;
+        }
+        ++target;
+      }
+    }
+    // writes "date street city" of the address valid at date
+    bool addressAt(std::ostream& os, const char id[], const char date[]) const {
+      uint64_t key;
+      uint32_t when;
+      if (!lookupId(id, key) || !lookupDate(date, when)) {
+        return false;
+      }
+      TIndex::CCursor at = db.floor(TPerson{key, when, 0, 0, 0, 0});
+      if (!at.valid() || at->m_Id != key) {
+        return false;
+      }
+      const CStringPool& pool = m_storage->m_pool;
+      writeDate(os, at->m_Date);
+      os << " " << pool.get(at->m_Street) << " " << pool.get(at->m_City) << "\n";
+      return true;
+    }
+    // People who came to city from elsewhere, or were registered there, on
+    // a date in [from, to]. Writes "date id name surname" lines in date
+    // order and returns their count. Dates that are not YYYY-MM-DD have no
+    // calendar order, as bounds they match nothing.
+    size_t movedInto(std::ostream& os, const char city[], const char from[], const char to[]) const {
+      const CStringPool& pool = m_storage->m_pool;
+      uint32_t value, first, last;
+      if (!pool.find(city, value) || !CKeyCodec::parseDate(from, first) || !CKeyCodec::parseDate(to, last)) {
+        return 0;
+      }
+      size_t found = 0;
+      for (TMoves::CCursor move = m_moves.lowerBound(TPosting{value, first, 0});
+           move.valid() && move->m_Value == value && move->m_Date <= last; move.next()) {
+        // a move within the city is not a move into it; a text date has no
+        // day before it to look at
+        if (move->m_Date > 0 && !(move->m_Date & CKeyCodec::DATE_TEXT)) {
+          TIndex::CCursor previous = db.floor(TPerson{move->m_Id, move->m_Date - 1, 0, 0, 0, 0});
+          if (previous.valid() && previous->m_Id == move->m_Id && previous->m_City == value) {
+            continue;
+          }
+        }
+        TIndex::CCursor person = db.lowerBound(TPerson{move->m_Id, 0, 0, 0, 0, 0});
+        writeDate(os, move->m_Date);
+        os << " ";
+        writeId(os, move->m_Id);
+        os << " " << pool.get(person->m_Name) << " " << pool.get(person->m_Surname) << "\n";
+        ++found;
+      }
+      return found;
+    }
+    bool print(std::ostream &os, const char id[]) const {
+      uint64_t key;
+      if (!lookupId(id, key)) {
+        return false;
+      }
+      TIndex::CCursor cursor = find(key);
+      if (!cursor.valid()) {
+        return false;
+      }
+      const CStringPool& pool = m_storage->m_pool;
+      // the index already keeps one person's records in date order
+      writeId(os, key);
+      os << " " << pool.get(cursor->m_Name) << " " << pool.get(cursor->m_Surname) << "\n";
+      for (; cursor.valid() && cursor->m_Id == key; cursor.next()) {
+        writeDate(os, cursor->m_Date);
+        os << " " << pool.get(cursor->m_Street) << " " << pool.get(cursor->m_City) << "\n";
+      }
+      return true;
+    }
+  private:
+    // strings referenced by the records; never shrinks while shared
+    struct TStorage {
+      TStorage() : m_refs(1) {}
+      CStringPool m_pool;
+      size_t m_refs;
+    };
+    TStorage* m_storage;
+    TIndex db;
+    // every address record under its city and street, every person under
+    // their surname
+    TPostings m_byCity;
+    TPostings m_byStreet;
+    TPostings m_bySurname;
+    // every address record under its city, in time order
+    TMoves m_moves;
+
+    void indexAddress(const TPerson& person) {
+      m_byCity.insert(TPosting{person.m_City, person.m_Date, person.m_Id});
+      m_byStreet.insert(TPosting{person.m_Street, person.m_Date, person.m_Id});
+      m_moves.insert(TPosting{person.m_City, person.m_Date, person.m_Id});
+    }
+    void rebuildPostings(const Vector<TPerson>& records) {
+      Vector<TPosting> postings;
+      postings.reserve(records.size());
+      for (const TPerson& record : records) {
+        postings.push_back(TPosting{record.m_City, record.m_Date, record.m_Id});
+      }
+      std::sort(postings.begin(), postings.end(), TPostingLess());
+      m_byCity.assign(postings.data(), postings.size());
+      std::sort(postings.begin(), postings.end(), TPostingByDateLess());
+      m_moves.assign(postings.data(), postings.size());
+      postings.clear();
+      for (const TPerson& record : records) {
+        postings.push_back(TPosting{record.m_Street, record.m_Date, record.m_Id});
+      }
+      std::sort(postings.begin(), postings.end(), TPostingLess());
+      m_byStreet.assign(postings.data(), postings.size());
+      postings.clear();
+      for (size_t i = 0; i < records.size(); ++i) {
+        if (!i || records[i].m_Id != records[i - 1].m_Id) {
+          postings.push_back(TPosting{records[i].m_Surname, 0, records[i].m_Id});
+        }
+      }
+      std::sort(postings.begin(), postings.end(), TPostingLess());
+      m_bySurname.assign(postings.data(), postings.size());
+    }
+
+    struct TBatchEntry {
+      TPerson m_Person;
+      size_t m_Order;
+      bool operator<(const TBatchEntry& other) const {
+        if (m_Person.m_Id != other.m_Person.m_Id) {
+          return m_Person.m_Id < other.m_Person.m_Id;
+        }
+        if (m_Person.m_Date != other.m_Person.m_Date) {
+          return m_Person.m_Date < other.m_Person.m_Date;
+        }
+        return m_Order < other.m_Order;
+      }
+    };
+
+    // sorts chunks on separate threads, then merges neighbouring runs
+    // pairwise, again in parallel
+    static void parallelSort(TBatchEntry* data, size_t count, unsigned threads) {
+      size_t chunks = threads;
+      while (chunks > 1 && count / chunks < MIN_SORT_CHUNK) {
+        --chunks;
+      }
+      size_t* bounds = new size_t[chunks + 1];
+      for (size_t i = 0; i <= chunks; ++i) {
+        bounds[i] = count * i / chunks;
+      }
+      std::thread* workers = new std::thread[chunks];
+      for (size_t i = 1; i < chunks; ++i) {
+        workers[i] = std::thread([=] { std::sort(data + bounds[i], data + bounds[i + 1]); });
+      }
+      std::sort(data + bounds[0], data + bounds[1]);
+      for (size_t i = 1; i < chunks; ++i) {
+        workers[i].join();
+      }
+      for (size_t width = 1; width < chunks; width *= 2) {
+        for (size_t i = 0; i + width < chunks; i += 2 * width) {
+          size_t last = i + 2 * width < chunks ? i + 2 * width : chunks;
+          workers[i] = std::thread([=] { std::inplace_merge(data + bounds[i], data + bounds[i + width], data + bounds[last]); });
+        }
+        for (size_t i = 0; i + width < chunks; i += 2 * width) {
+          workers[i].join();
+        }
+      }
+      delete[] workers;
+      delete[] bounds;
+    }
+    static const size_t MIN_SORT_CHUNK = 1 << 16;
+
+    void releaseStorage() {
+      if (--m_storage->m_refs == 0) {
+        delete m_storage;
+      }
+    }
+
+    // packed key of an ID, false if the ID cannot be in the register
+    bool lookupId(const char id[], uint64_t& key) const {
+      if (CKeyCodec::parseId(id, key)) {
+        return true;
+      }
+      uint32_t handle;
+      if (!m_storage->m_pool.find(id, handle)) {
+        return false;
+      }
+      key = CKeyCodec::ID_TEXT | handle;
+      return true;
+    }
+    bool lookupDate(const char date[], uint32_t& key) const {
+      uint32_t handle;
+      if (CKeyCodec::parseDate(date, key)) {
+        return true;
+      }
+      if (!m_storage->m_pool.find(date, handle)) {
+        return false;
+      }
+      key = CKeyCodec::DATE_TEXT | handle;
+      return true;
+    }
+    uint64_t internId(const char id[]) {
+      uint64_t key;
+      return CKeyCodec::parseId(id, key) ? key : CKeyCodec::ID_TEXT | m_storage->m_pool.intern(id);
+    }
+    uint32_t internDate(const char date[]) {
+      uint32_t key;
+      return CKeyCodec::parseDate(date, key) ? key : CKeyCodec::DATE_TEXT | m_storage->m_pool.intern(date);
+    }
+    void writeId(std::ostream& os, uint64_t key) const {
+      if (key & CKeyCodec::ID_TEXT) {
+        os << m_storage->m_pool.get((uint32_t)(key & ~CKeyCodec::ID_TEXT));
+        return;
+      }
+      char buf[CKeyCodec::ID_LENGTH + 1];
+      CKeyCodec::formatId(key, buf);
+      os.write(buf, CKeyCodec::ID_LENGTH);
+    }
+    void writeDate(std::ostream& os, uint32_t key) const {
+      if (key & CKeyCodec::DATE_TEXT) {
+        os << m_storage->m_pool.get(key & ~CKeyCodec::DATE_TEXT);
+        return;
+      }
+      char buf[CKeyCodec::DATE_LENGTH + 1];
+      CKeyCodec::formatDate(key, buf);
+      os.write(buf, CKeyCodec::DATE_LENGTH);
+    }
+    // cursor at the oldest record of the person, invalid if there is none
+    TIndex::CCursor find(uint64_t key) const {
+      // date 0 sorts before every other one
+      TIndex::CCursor cursor = db.lowerBound(TPerson{key, 0, 0, 0, 0, 0});
+      if (cursor.valid() && cursor->m_Id != key) {
+        return TIndex::CCursor();
+      }
+      return cursor;
+    }
+};
+
+// CRegister for many reading threads and writers that take turns. A writer
+// changes a private register under a mutex and publishes an O(1) copy of
+// it; readers print() from the latest published copy without locking and
+// without touching any reference count, so they never wait for a writer.
+// A replaced copy is freed by a later writer once no reader that could
+// still see it is inside print() (epoch-based reclamation).
+//
+// IDs outside the canonical form need the string pool's hash table, which
+// the writer may be rehashing, so print() of such an ID takes the mutex.
+class CConcurrentRegister {
+  public:
+    CConcurrentRegister() : m_published(new CRegister()), m_epoch(1), m_retired(nullptr) {
+      for (size_t i = 0; i < MAX_READERS; ++i) {
+        m_readers[i].m_epoch.store(0, std::memory_order_relaxed);
+      }
+    }
+    CConcurrentRegister(const CConcurrentRegister&) = delete;
+    CConcurrentRegister& operator=(const CConcurrentRegister&) = delete;
+    ~CConcurrentRegister() {
+      delete m_published.load();
+      while (m_retired) {
+        TRetired* next = m_retired->m_next;
+        delete m_retired->m_version;
+        delete m_retired;
+        m_retired = next;
+      }
+    }
+    bool add(const char id[], const char name[], const char surname[], const char date[], const char street[], const char city[]) {
+      std::lock_guard<std::mutex> lock(m_writeLock);
+      return m_writer.add(id, name, surname, date, street, city) && publish();
+    }
+    bool resettle(const char id[], const char date[], const char street[], const char city[]) {
+      std::lock_guard<std::mutex> lock(m_writeLock);
+      return m_writer.resettle(id, date, street, city) && publish();
+    }
+    size_t bulkLoad(const TRecord* records, size_t count, unsigned threads = 1) {
+      std::lock_guard<std::mutex> lock(m_writeLock);
+      size_t accepted = m_writer.bulkLoad(records, count, threads);
+      publish();
+      return accepted;
+    }
+    bool print(std::ostream &os, const char id[]) const {
+      uint64_t key;
+      if (!CKeyCodec::parseId(id, key)) {
+        std::lock_guard<std::mutex> lock(m_writeLock);
+        return m_writer.print(os, id);
+      }
+      size_t slot = enter();
+      bool found = m_published.load()->print(os, id);
+      m_readers[slot].m_epoch.store(0, std::memory_order_release);
+      return found;
+    }
+  private:
+    struct alignas(64) TReader {
+      // epoch at which the reader entered, 0 while the slot is free
+      std::atomic<uint64_t> m_epoch;
+    };
+    struct TRetired {
+      const CRegister* m_version;
+      uint64_t m_epoch;
+      TRetired* m_next;
+    };
+    static const size_t MAX_READERS = 128;
+
+    mutable std::mutex m_writeLock;
+    CRegister m_writer;
+    std::atomic<const CRegister*> m_published;
+    std::atomic<uint64_t> m_epoch;
+    mutable TReader m_readers[MAX_READERS];
+    // replaced versions, newest first; only touched under m_writeLock
+    TRetired* m_retired;
+
+    // Claims a reader slot stamped with the current epoch. A writer that
+    // swaps the published copy afterwards retires it with an epoch at
+    // least as large, so it stays alive until the slot is released.
+    size_t enter() const {
+      uint64_t epoch = m_epoch.load();
+      size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % MAX_READERS;
+      for (;; slot = (slot + 1) % MAX_READERS) {
+        uint64_t expected = 0;
+        if (m_readers[slot].m_epoch.load(std::memory_order_relaxed) == 0
+            && m_readers[slot].m_epoch.compare_exchange_strong(expected, epoch)) {
+          return slot;
+        }
+      }
+    }
+    bool publish() {
+      const CRegister* old = m_published.exchange(new CRegister(m_writer));
+      uint64_t epoch = m_epoch.fetch_add(1);
+      m_retired = new TRetired{old, epoch, m_retired};
+      reclaim();
+      return true;
+    }
+    void reclaim() {
+      uint64_t oldest = UINT64_MAX;
+      for (size_t i = 0; i < MAX_READERS; ++i) {
+        uint64_t epoch = m_readers[i].m_epoch.load();
+        if (epoch && epoch < oldest) {
+          oldest = epoch;
+        }
+      }
+      for (TRetired** it = &m_retired; *it;) {
+        if ((*it)->m_epoch < oldest) {
+          TRetired* done = *it;
+          *it = done->m_next;
+          delete done->m_version;
+          delete done;
+        } else {
+          it = &(*it)->m_next;
+        }
+      }
+    }
+};
+
+// CRegister split into independent shards by a hash of the ID, each with
+// its own lock, so writers to different shards do not wait for each other.
+// All records of a person live in one shard. Queries over all people run
+// on every shard and merge the per-shard answers line by line, which for
+// canonical IDs and dates is the order a single CRegister would give.
+// Text IDs and dates sort by first appearance, and that order is only
+// known within a shard: such lines keep their per-shard order and are
+// merged with the others by their text.
+class CShardedRegister {
+  public:
+    explicit CShardedRegister(size_t shards = 16) : m_shards(new TShard[shards ? shards : 1]), m_shardCount(shards ? shards : 1) {}
+    CShardedRegister(const CShardedRegister&) = delete;
+    CShardedRegister& operator=(const CShardedRegister&) = delete;
+    ~CShardedRegister() {
+      delete[] m_shards;
+    }
+    bool add(const char id[], const char name[], const char surname[], const char date[], const char street[], const char city[]) {
+      TShard& shard = shardOf(id);
+      std::lock_guard<std::mutex> lock(shard.m_lock);
+      return shard.m_register.add(id, name, surname, date, street, city);
+    }
+    bool resettle(const char id[], const char date[], const char street[], const char city[]) {
+      TShard& shard = shardOf(id);
+      std::lock_guard<std::mutex> lock(shard.m_lock);
+      return shard.m_register.resettle(id, date, street, city);
+    }
+    bool print(std::ostream &os, const char id[]) const {
+      TShard& shard = shardOf(id);
+      std::lock_guard<std::mutex> lock(shard.m_lock);
+      return shard.m_register.print(os, id);
+    }
+    bool addressAt(std::ostream& os, const char id[], const char date[]) const {
+      TShard& shard = shardOf(id);
+      std::lock_guard<std::mutex> lock(shard.m_lock);
+      return shard.m_register.addressAt(os, id, date);
+    }
+    // Splits the batch by shard, keeping the row order, and loads the
+    // shards on up to threads threads.
+    size_t bulkLoad(const TRecord* records, size_t count, unsigned threads = 1) {
+      Vector<TRecord>* parts = new Vector<TRecord>[m_shardCount];
+      for (size_t i = 0; i < count; ++i) {
+        parts[shardIndex(records[i].m_Id)].push_back(records[i]);
+      }
+      std::atomic<size_t> accepted(0);
+      forEachShard(threads, [&](size_t index) {
+        TShard& shard = m_shards[index];
+        std::lock_guard<std::mutex> lock(shard.m_lock);
+        accepted += shard.m_register.bulkLoad(parts[index].data(), parts[index].size());
+      });
+      delete[] parts;
+      return accepted;
+    }
+    size_t residents(std::ostream& os, const char city[], const char street[] = nullptr, const char surname[] = nullptr,
+                     const char date[] = nullptr, unsigned threads = 1) const {
+      return gather(os, threads, [&](const CRegister& reg, std::ostream& out) {
+        return reg.residents(out, city, street, surname, date);
+      });
+    }
+    size_t movedInto(std::ostream& os, const char city[], const char from[], const char to[], unsigned threads = 1) const {
+      return gather(os, threads, [&](const CRegister& reg, std::ostream& out) {
+        return reg.movedInto(out, city, from, to);
+      });
+    }
+  private:
+    struct TShard {
+      std::mutex m_lock;
+      CRegister m_register;
+    };
+    TShard* m_shards;
+    size_t m_shardCount;
+
+    size_t shardIndex(const char id[]) const {
+      return CStringPool::hash(id, strlen(id)) % m_shardCount;
+    }
+    TShard& shardOf(const char id[]) const {
+      return m_shards[shardIndex(id)];
+    }
+    // runs fn(shard index) for every shard, spreading them over threads
+    template <class TFn>
+    void forEachShard(unsigned threads, TFn fn) const {
+      size_t workers = threads > 1 ? (threads < m_shardCount ? threads : m_shardCount) : 1;
+      std::atomic<size_t> next(0);
+      auto work = [&] {
+        for (size_t index; (index = next++) < m_shardCount;) {
+          fn(index);
+        }
+      };
+      std::thread* pool = new std::thread[workers];
+      for (size_t i = 1; i < workers; ++i) {
+        pool[i] = std::thread(work);
+      }
+      work();
+      for (size_t i = 1; i < workers; ++i) {
+        pool[i].join();
+      }
+      delete[] pool;
+    }
+    // asks every shard, then merges their sorted line lists
+    template <class TQuery>
+    size_t gather(std::ostream& os, unsigned threads, TQuery query) const {
+      std::string* answers = new std::string[m_shardCount];
+      std::atomic<size_t> found(0);
+      forEachShard(threads, [&](size_t index) {
+        std::ostringstream out;
+        {
+          std::lock_guard<std::mutex> lock(m_shards[index].m_lock);
+          found += query(m_shards[index].m_register, out);
+        }
+        answers[index] = out.str();
+      });
+      // every line ends with '\n', ends[i] is where the current one does
+      size_t* positions = new size_t[m_shardCount]();
+      size_t* ends = new size_t[m_shardCount];
+      for (size_t i = 0; i < m_shardCount; ++i) {
+        ends[i] = answers[i].find('\n');
+      }
+      for (;;) {
+        size_t best = m_shardCount;
+        for (size_t i = 0; i < m_shardCount; ++i) {
+          if (positions[i] < answers[i].size()
+              && (best == m_shardCount
+                  || lineLess(answers[i].c_str() + positions[i], ends[i] - positions[i],
+                              answers[best].c_str() + positions[best], ends[best] - positions[best]))) {
+            best = i;
+          }
+        }
+        if (best == m_shardCount) {
+          break;
+        }
+        os.write(answers[best].c_str() + positions[best], ends[best] + 1 - positions[best]);
+        positions[best] = ends[best] + 1;
+        ends[best] = answers[best].find('\n', positions[best]);
+      }
+      delete[] ends;
+      delete[] positions;
+      delete[] answers;
+      return found;
+    }
+    // the order strcmp gives, limited to one line each
+    static bool lineLess(const char* a, size_t aLength, const char* b, size_t bLength) {
+      int cmp = memcmp(a, b, aLength < bLength ? aLength : bLength);
+      return cmp < 0 || (cmp == 0 && aLength < bLength);
+    }
+};
+
+// Register kept in two files next to each other: an immutable snapshot that
+// is mapped read-only and paged in on demand, and an append-only log of the
+// add() and resettle() calls made since that snapshot was written. open()
+// only maps the snapshot and replays the log into a small in-memory delta,
+// compact() folds the delta into a new snapshot.
+//
+// Snapshot layout, native byte order:
+//   THeader, padded to PAGE_SIZE
+//   TPerson records[recordCount], sorted by TPersonLess
+//   uint64_t offsets[stringCount + 1], start of each string in the heap
+//   uint32_t slots[slotCount], open addressing hash of the string handles
+//   heap of '\0' terminated strings
+// Handles below stringCount refer to the snapshot strings, the ones above
+// to strings interned since, so compaction never renumbers a record.
+//
+// Log entry: uint32_t size of the rest, the operation byte, then for each
+// field a uint32_t length and the characters including the '\0'.
+class CRegisterStore {
+    using TIndex = CBTree<TPerson, TPersonLess>;
+  public:
+    CRegisterStore() : m_header(nullptr), m_mappedSize(0), m_log(-1), m_replaying(false) {}
+    CRegisterStore(const CRegisterStore&) = delete;
+    CRegisterStore& operator=(const CRegisterStore&) = delete;
+    ~CRegisterStore() {
+      close();
+    }
+    // opens path.snap and path.log, missing files mean an empty register
+    bool open(const char path[]) {
+      close();
+      m_snapshotPath = withSuffix(path, ".snap");
+      m_logPath = withSuffix(path, ".log");
+      if (!mapSnapshot(m_header, m_mappedSize) || !replayLog()) {
+        close();
+        return false;
+      }
+      m_log = ::open(m_logPath.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+      if (m_log < 0) {
+        close();
+        return false;
+      }
+      return true;
+    }
+    void close() {
+      closeLog();
+      unmapSnapshot();
+      m_delta = TIndex();
+      m_pool = CStringPool();
+    }
+    bool add(const char id[], const char name[], const char surname[], const char date[], const char street[], const char city[]) {
+      uint64_t key;
+      TPerson owner;
+      if (lookupId(id, key) && first(key, owner)) {
+        return false;
       }
-      return *this;
+      const char* fields[] = {id, name, surname, date, street, city};
+      if (!appendLog(OP_ADD, fields, 6)) {
+        return false;
+      }
+      m_delta.insert(TPerson{internId(id), internDate(date), intern(name), intern(surname), intern(street), intern(city)});
+      maybeCompact();
+      return true;
     }
-    CString& operator=(CString&& other) noexcept {
-      if (this != &other) {
-        delete[] m_data;
-        m_data = other.m_data;
-        m_size = other.m_size;
-        other.m_data = nullptr;
-        other.m_size = 0;
+    bool resettle(const char id[], const char date[], const char street[], const char city[]) {
+      uint64_t key;
+      TPerson owner;
+      if (!lookupId(id, key) || !first(key, owner)) {
+        return false;
       }
-      return *this;
+      uint32_t when;
+      if (lookupDate(date, when)) {
+        TPerson probe{key, when, 0, 0, 0, 0};
+        if (snapshotContains(probe) || deltaContains(probe)) {
+          return false;
+        }
+      }
+      const char* fields[] = {id, date, street, city};
+      if (!appendLog(OP_RESETTLE, fields, 4)) {
+        return false;
+      }
+      m_delta.insert(TPerson{key, internDate(date), owner.m_Name, owner.m_Surname, intern(street), intern(city)});
+      maybeCompact();
+      return true;
     }
-    ~CString() {
-      delete[] m_data;
+    bool print(std::ostream &os, const char id[]) const {
+      uint64_t key;
+      TPerson owner;
+      if (!lookupId(id, key) || !first(key, owner)) {
+        return false;
+      }
+      TPerson probe{key, 0, 0, 0, 0, 0};
+      size_t pos = snapshotLowerBound(probe);
+      TIndex::CCursor cursor = m_delta.lowerBound(probe);
+      writeId(os, key);
+      os << " " << text(owner.m_Name) << " " << text(owner.m_Surname) << "\n";
+      // both parts are in date order, merge them
+      for (;;) {
+        bool fromSnapshot = pos < recordCount() && records()[pos].m_Id == key;
+        bool fromDelta = cursor.valid() && cursor->m_Id == key;
+        if (!fromSnapshot && !fromDelta) {
+          break;
+        }
+        const TPerson* person;
+        if (fromSnapshot && (!fromDelta || records()[pos].m_Date < cursor->m_Date)) {
+          person = &records()[pos++];
+        } else {
+          person = &*cursor;
+          cursor.next();
+        }
+        writeDate(os, person->m_Date);
+        os << " " << text(person->m_Street) << " " << text(person->m_City) << "\n";
+      }
+      return true;
     }
-    const char* c_str() const {
-      return m_data;
+    // Writes the snapshot and the delta into a new snapshot, replaces the
+    // old one and empties the log. Replaying a log whose changes already
+    // made it into the snapshot only repeats rejected calls, so a crash
+    // between the rename and the truncation loses nothing. Once the rename
+    // went through, a failure leaves the store read-only: the old view is
+    // still correct, but appending to the log would no longer be.
+    bool compact() {
+      if (m_log < 0) {
+        return false;
+      }
+      if (!m_delta.size()) {
+        return true;
+      }
+      CString tmpPath = withSuffix(m_snapshotPath.c_str(), ".tmp");
+      if (!writeSnapshot(tmpPath.c_str())) {
+        unlink(tmpPath.c_str());
+        return false;
+      }
+      if (rename(tmpPath.c_str(), m_snapshotPath.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+      }
+      const THeader* header;
+      size_t mappedSize;
+      if (!mapSnapshot(header, mappedSize) || !header) {
+        closeLog();
+        return false;
+      }
+      unmapSnapshot();
+      m_header = header;
+      m_mappedSize = mappedSize;
+      m_delta = TIndex();
+      m_pool = CStringPool();
+      if (ftruncate(m_log, 0) != 0) {
+        closeLog();
+        return false;
+      }
+      return true;
     }
     size_t size() const {
-      return m_size;
+      return recordCount() + m_delta.size();
     }
-    bool operator==(const CString& other) const {
-      return strcmp(m_data, other.m_data) == 0;
+  private:
+    struct THeader {
+      char m_Magic[8];
+      uint64_t m_RecordCount;
+      uint64_t m_StringCount;
+      uint64_t m_SlotCount;
+      uint64_t m_HeapSize;
+      uint64_t m_RecordsOffset;
+      uint64_t m_OffsetsOffset;
+      uint64_t m_SlotsOffset;
+      uint64_t m_HeapOffset;
+    };
+    static constexpr char MAGIC[8] = {'C', 'R', 'E', 'G', 'S', 'N', 'P', '1'};
+    static const size_t PAGE_SIZE = 4096;
+    static const uint32_t EMPTY = UINT32_MAX;
+    static const char OP_ADD = 'A';
+    static const char OP_RESETTLE = 'R';
+    // the delta is folded in once it holds this many records and at least
+    // a quarter of the snapshot
+    static const size_t COMPACT_MIN_RECORDS = 1 << 16;
+
+    CString m_snapshotPath;
+    CString m_logPath;
+    const THeader* m_header;
+    size_t m_mappedSize;
+    int m_log;
+    bool m_replaying;
+    // strings and records added since the snapshot
+    CStringPool m_pool;
+    TIndex m_delta;
+
+    static CString withSuffix(const char* path, const char* suffix) {
+      size_t pathLength = strlen(path), suffixLength = strlen(suffix);
+      char* buf = new char[pathLength + suffixLength + 1];
+      memcpy(buf, path, pathLength);
+      memcpy(buf + pathLength, suffix, suffixLength + 1);
+      CString result(buf);
+      delete[] buf;
+      return result;
     }
-    bool operator!=(const CString& other) const {
-      return strcmp(m_data, other.m_data) != 0;
+    const char* base() const {
+      return reinterpret_cast<const char*>(m_header);
     }
-    char& operator[](size_t index) {
-      return m_data[index];
+    size_t recordCount() const {
+      return m_header ? m_header->m_RecordCount : 0;
     }
-    const char& operator[](size_t index) const {
-      return m_data[index];
+    size_t stringCount() const {
+      return m_header ? m_header->m_StringCount : 0;
     }
-    friend std::ostream& operator<<(std::ostream& os, const CString& str) {
-      return os << str.c_str();
+    const TPerson* records() const {
+      return reinterpret_cast<const TPerson*>(base() + m_header->m_RecordsOffset);
     }
-    bool operator<(const CString& other) const {
-      return strcmp(m_data, other.m_data) < 0;
+    const uint64_t* offsets() const {
+      return reinterpret_cast<const uint64_t*>(base() + m_header->m_OffsetsOffset);
     }
-    bool operator>(const CString& other) const {
-      return strcmp(m_data, other.m_data) > 0;
+    const uint32_t* slots() const {
+      return reinterpret_cast<const uint32_t*>(base() + m_header->m_SlotsOffset);
+    }
+    const char* heap() const {
+      return base() + m_header->m_HeapOffset;
     }
-  private:
-    char* m_data;
-    size_t m_size;
-};
-
-struct TPerson {
-  CString m_Id;
-  CString m_Name;
-  CString m_Surname;
-  CString m_Date;
-  CString m_Street;
-  CString m_City;
-};
 
-class Vector {
-  public:
-    using value_type = TPerson;
-    Vector() : m_capacity(0), m_size(0), m_data(nullptr) {}
-    Vector(const Vector& other) : m_capacity(other.m_capacity), m_size(other.m_size) {
-      m_data = new TPerson[m_capacity];
-      for (size_t i = 0; i < m_size; i++) {
-        m_data[i] = other.m_data[i];
+    // a missing snapshot maps to nullptr
+    bool mapSnapshot(const THeader*& header, size_t& mappedSize) const {
+      header = nullptr;
+      mappedSize = 0;
+      int fd = ::open(m_snapshotPath.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return errno == ENOENT;
       }
+      struct stat info;
+      if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(THeader)) {
+        ::close(fd);
+        return false;
+      }
+      void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close(fd);
+      if (mapped == MAP_FAILED) {
+        return false;
+      }
+      size_t size = info.st_size;
+      const THeader& h = *static_cast<const THeader*>(mapped);
+      // counts are bounded first so that the offset sums cannot wrap around
+      bool valid = memcmp(h.m_Magic, MAGIC, sizeof(MAGIC)) == 0 && h.m_RecordsOffset % PAGE_SIZE == 0
+                   && h.m_RecordsOffset <= size && h.m_RecordCount <= size / sizeof(TPerson)
+                   && h.m_StringCount < size / sizeof(uint64_t) && h.m_SlotCount <= size / sizeof(uint32_t)
+                   && h.m_HeapSize <= size
+                   && h.m_OffsetsOffset == h.m_RecordsOffset + h.m_RecordCount * sizeof(TPerson)
+                   && h.m_SlotsOffset == h.m_OffsetsOffset + (h.m_StringCount + 1) * sizeof(uint64_t)
+                   && h.m_HeapOffset == h.m_SlotsOffset + h.m_SlotCount * sizeof(uint32_t)
+                   && h.m_HeapOffset + h.m_HeapSize <= size && (h.m_SlotCount & (h.m_SlotCount - 1)) == 0
+                   && h.m_SlotCount > h.m_StringCount && validTables(h);
+      if (!valid) {
+        munmap(mapped, size);
+        return false;
+      }
+      // lookups jump around, do not read ahead
+      madvise(mapped, size, MADV_RANDOM);
+      header = &h;
+      mappedSize = size;
+      return true;
     }
-    Vector(Vector&& other) noexcept : m_capacity(other.m_capacity), m_size(other.m_size), m_data(other.m_data) {
-      other.m_data = nullptr;
-      other.m_capacity = 0;
-      other.m_size = 0;
-    }
-    Vector& operator=(const Vector& other) {
-      if (this == &other) return *this;
-      TPerson* newData = new TPerson[other.m_capacity];
-      for (size_t i = 0; i < other.m_size; ++i) {
-        newData[i] = other.m_data[i];
-      }
-      delete[] m_data;
-      m_data = newData;
-      m_capacity = other.m_capacity;
-      m_size = other.m_size;
-      return *this;
-    }
-    Vector& operator=(Vector&& other) noexcept {
-      if (this != &other) {
-        delete[] m_data;
-        m_data = other.m_data;
-        m_capacity = other.m_capacity;
-        m_size = other.m_size;
-        other.m_data = nullptr;
-        other.m_capacity = 0;
-        other.m_size = 0;
+    // Offsets must stay inside the heap and slots must name a snapshot
+    // string. The heap ends with a '\0', so no string runs past it. Record
+    // handles are checked when they are read.
+    static bool validTables(const THeader& h) {
+      const char* data = reinterpret_cast<const char*>(&h);
+      const uint64_t* offsets = reinterpret_cast<const uint64_t*>(data + h.m_OffsetsOffset);
+      const uint32_t* slots = reinterpret_cast<const uint32_t*>(data + h.m_SlotsOffset);
+      if (offsets[0] != 0 || offsets[h.m_StringCount] != h.m_HeapSize
+          || (h.m_HeapSize && data[h.m_HeapOffset + h.m_HeapSize - 1] != '\0')) {
+        return false;
       }
-      return *this;
+      for (size_t i = 0; i < h.m_StringCount; ++i) {
+        if (offsets[i + 1] <= offsets[i]) {
+          return false;
+        }
+      }
+      for (size_t i = 0; i < h.m_SlotCount; ++i) {
+        if (slots[i] != EMPTY && slots[i] >= h.m_StringCount) {
+          return false;
+        }
+      }
+      return true;
     }
-    ~Vector() {
-      delete[] m_data;
+    void closeLog() {
+      if (m_log >= 0) {
+        ::close(m_log);
+        m_log = -1;
+      }
     }
-    void push_back(value_type&& value) {
-      if (m_size >= m_capacity) {
-        realloc();
+    void unmapSnapshot() {
+      if (m_header) {
+        munmap(const_cast<THeader*>(m_header), m_mappedSize);
+        m_header = nullptr;
+        m_mappedSize = 0;
       }
-      m_data[m_size++] = std::move(value);
     }
-    size_t size() const {
-      return m_size;
+    bool writeSnapshot(const char* path) const {
+      size_t snapshotStrings = stringCount(), strings = snapshotStrings + m_pool.size();
+      size_t heapSize = m_header ? m_header->m_HeapSize : 0;
+      for (size_t i = 0; i < m_pool.size(); ++i) {
+        heapSize += m_pool.get(i).size() + 1;
+      }
+      size_t slotCount = 64;
+      while (slotCount < strings * 2) {
+        slotCount *= 2;
+      }
+      THeader header;
+      memcpy(header.m_Magic, MAGIC, sizeof(MAGIC));
+      header.m_RecordCount = size();
+      header.m_StringCount = strings;
+      header.m_SlotCount = slotCount;
+      header.m_HeapSize = heapSize;
+      header.m_RecordsOffset = PAGE_SIZE;
+      header.m_OffsetsOffset = header.m_RecordsOffset + header.m_RecordCount * sizeof(TPerson);
+      header.m_SlotsOffset = header.m_OffsetsOffset + (strings + 1) * sizeof(uint64_t);
+      header.m_HeapOffset = header.m_SlotsOffset + slotCount * sizeof(uint32_t);
+
+      FILE* file = fopen(path, "wb");
+      if (!file) {
+        return false;
+      }
+      char page[PAGE_SIZE] = {};
+      memcpy(page, &header, sizeof(header));
+      fwrite(page, 1, PAGE_SIZE, file);
+      // records: merge of the two sorted parts
+      size_t pos = 0;
+      TIndex::CCursor cursor = m_delta.begin();
+      while (pos < recordCount() || cursor.valid()) {
+        if (pos < recordCount() && (!cursor.valid() || TPersonLess()(records()[pos], *cursor))) {
+          writeRecord(file, records()[pos++]);
+        } else {
+          writeRecord(file, *cursor);
+          cursor.next();
+        }
+      }
+      uint64_t offset = 0;
+      for (size_t i = 0; i < strings; ++i) {
+        fwrite(&offset, sizeof(offset), 1, file);
+        offset += (i < snapshotStrings ? offsets()[i + 1] - offsets()[i] : m_pool.get(i - snapshotStrings).size() + 1);
+      }
+      fwrite(&offset, sizeof(offset), 1, file);
+      uint32_t* table = new uint32_t[slotCount];
+      for (size_t i = 0; i < slotCount; ++i) {
+        table[i] = EMPTY;
+      }
+      for (size_t i = 0; i < strings; ++i) {
+        const char* str = text(i);
+        size_t slot = CStringPool::hash(str, strlen(str)) & (slotCount - 1);
+        while (table[slot] != EMPTY) {
+          slot = (slot + 1) & (slotCount - 1);
+        }
+        table[slot] = (uint32_t)i;
+      }
+      fwrite(table, sizeof(uint32_t), slotCount, file);
+      delete[] table;
+      if (snapshotStrings) {
+        fwrite(heap(), 1, m_header->m_HeapSize, file);
+      }
+      for (size_t i = 0; i < m_pool.size(); ++i) {
+        fwrite(m_pool.get(i).c_str(), 1, m_pool.get(i).size() + 1, file);
+      }
+      bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && !ferror(file);
+      return fclose(file) == 0 && ok;
     }
-    value_type& at(size_t index) {
-      assert(index < size());
-      return m_data[index];
+
+    // copied field by field so that the padding goes to the disk zeroed
+    static void writeRecord(FILE* file, const TPerson& person) {
+      TPerson record;
+      memset(&record, 0, sizeof(record));
+      record.m_Id = person.m_Id;
+      record.m_Date = person.m_Date;
+      record.m_Name = person.m_Name;
+      record.m_Surname = person.m_Surname;
+      record.m_Street = person.m_Street;
+      record.m_City = person.m_City;
+      fwrite(&record, sizeof(record), 1, file);
     }
-    const value_type& at(size_t index) const {
-      assert(index < size());
-      return m_data[index];
+
+    bool replayLog() {
+      int fd = ::open(m_logPath.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return errno == ENOENT;
+      }
+      struct stat info;
+      if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+      }
+      size_t size = info.st_size;
+      char* data = new char[size + 1];
+      size_t done = 0;
+      while (done < size) {
+        ssize_t got = read(fd, data + done, size - done);
+        if (got <= 0) {
+          break;
+        }
+        done += got;
+      }
+      ::close(fd);
+      // a torn entry at the end is what an interrupted append leaves behind
+      size_t pos = 0;
+      m_replaying = true;
+      while (pos < done) {
+        size_t entryEnd;
+        if (!replayEntry(data, pos, done, entryEnd)) {
+          break;
+        }
+        pos = entryEnd;
+      }
+      m_replaying = false;
+      delete[] data;
+      return pos == size || truncate(m_logPath.c_str(), pos) == 0;
     }
-    size_t lower_bound(const CString& id) const {
-      size_t left = 0, right = m_size;
-      while (left < right) {
-        size_t mid = left + (right - left) / 2;
-        if (m_data[mid].m_Id < id) {
-          left = mid + 1;
-        } else {
-          right = mid;
+    bool replayEntry(const char* data, size_t pos, size_t size, size_t& entryEnd) {
+      uint32_t length;
+      if (size - pos < sizeof(length) + 1) {
+        return false;
+      }
+      memcpy(&length, data + pos, sizeof(length));
+      pos += sizeof(length);
+      if (length < 1 || size - pos < length) {
+        return false;
+      }
+      entryEnd = pos + length;
+      char op = data[pos++];
+      const char* fields[6];
+      size_t count = op == OP_ADD ? 6 : 4;
+      for (size_t i = 0; i < count; ++i) {
+        uint32_t fieldLength;
+        if (entryEnd - pos < sizeof(fieldLength)) {
+          return false;
+        }
+        memcpy(&fieldLength, data + pos, sizeof(fieldLength));
+        pos += sizeof(fieldLength);
+        if (fieldLength < 1 || entryEnd - pos < fieldLength || data[pos + fieldLength - 1] != '\0') {
+          return false;
         }
+        fields[i] = data + pos;
+        pos += fieldLength;
       }
-      return left;
+      if (op == OP_ADD) {
+        add(fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+      } else if (op == OP_RESETTLE) {
+        resettle(fields[0], fields[1], fields[2], fields[3]);
+      } else {
+        return false;
+      }
+      return true;
     }
-    void insert(size_t index, value_type&& value) {
-      assert(index <= m_size);
-      if (m_size == m_capacity) {
-        realloc();
+    bool appendLog(char op, const char* const* fields, size_t count) {
+      if (m_replaying) {
+        return true;
       }
-      for (size_t i = m_size; i > index; --i) {
-        m_data[i] = std::move(m_data[i - 1]);
+      if (m_log < 0) {
+        return false;
       }
-      m_data[index] = std::move(value);
-      ++m_size;
+      uint32_t length = 1;
+      for (size_t i = 0; i < count; ++i) {
+        length += sizeof(uint32_t) + strlen(fields[i]) + 1;
+      }
+      char* entry = new char[sizeof(length) + length];
+      size_t pos = 0;
+      memcpy(entry, &length, sizeof(length));
+      pos += sizeof(length);
+      entry[pos++] = op;
+      for (size_t i = 0; i < count; ++i) {
+        uint32_t fieldLength = strlen(fields[i]) + 1;
+        memcpy(entry + pos, &fieldLength, sizeof(fieldLength));
+        pos += sizeof(fieldLength);
+        memcpy(entry + pos, fields[i], fieldLength);
+        pos += fieldLength;
+      }
+      bool ok = write(m_log, entry, pos) == (ssize_t)pos;
+      delete[] entry;
+      return ok;
     }
-  private:
-    size_t m_capacity;
-    size_t m_size;
-    value_type* m_data;
-    void realloc() {
-      m_capacity = m_capacity * 2 + 1;
-      TPerson* data = new TPerson[m_capacity];
-      for (size_t i = 0; i < m_size; i++) {
-        data[i] = std::move(m_data[i]);
+    // a failed compaction does not undo the change that triggered it
+    void maybeCompact() {
+      if (!m_replaying && m_delta.size() >= COMPACT_MIN_RECORDS && m_delta.size() * 4 >= recordCount()) {
+        compact();
       }
-      delete[] m_data;
-      m_data = data;
     }
-};
 
-class CRegister {
-  public:
-    CRegister() = default;
-    ~CRegister() = default;
-    CRegister(const CRegister& other) : db(other.db) {}
-    CRegister& operator=(const CRegister& other) {
-      if (this != &other) {
-        db = other.db;
+    // a handle that names no string comes from a damaged snapshot record
+    const char* text(size_t handle) const {
+      if (handle < stringCount()) {
+        return heap() + offsets()[handle];
       }
-      return *this;
+      handle -= stringCount();
+      return handle < m_pool.size() ? m_pool.get(handle).c_str() : "";
     }
-    bool add(const char id[], const char name[], const char surname[], const char date[], const char street[], const char city[]) {
-      CString cid(id);
-      size_t pos = db.lower_bound(cid);
-      if (pos < db.size() && db.at(pos).m_Id == cid) {
+    bool findString(const char* str, uint32_t& handle) const {
+      if (m_header) {
+        size_t len = strlen(str), mask = m_header->m_SlotCount - 1;
+        for (size_t slot = CStringPool::hash(str, len) & mask; slots()[slot] != EMPTY; slot = (slot + 1) & mask) {
+          uint32_t candidate = slots()[slot];
+          if (offsets()[candidate + 1] - offsets()[candidate] == len + 1 && memcmp(heap() + offsets()[candidate], str, len) == 0) {
+            handle = candidate;
+            return true;
+          }
+        }
+      }
+      if (!m_pool.find(str, handle)) {
         return false;
       }
-      db.insert(pos, TPerson{std::move(cid), CString(name), CString(surname), CString(date), CString(street), CString(city)});
+      handle += stringCount();
       return true;
     }
-    bool resettle(const char id[], const char date[], const char street[], const char city[]) {
-      CString cid(id);
-      size_t pos = db.lower_bound(cid);
-      if (pos == db.size() || db.at(pos).m_Id != cid) {
-        return false;
+    uint32_t intern(const char* str) {
+      uint32_t handle;
+      return findString(str, handle) ? handle : (uint32_t)(stringCount() + m_pool.intern(str));
+    }
+    bool lookupId(const char id[], uint64_t& key) const {
+      if (CKeyCodec::parseId(id, key)) {
+        return true;
       }
-      for (size_t i = pos; i < db.size() && db.at(i).m_Id == cid; ++i) {
-        if (db.at(i).m_Date == date) {
-          return false;
-        }
+      uint32_t handle;
+      if (!findString(id, handle)) {
+        return false;
       }
-      db.insert(pos, TPerson{std::move(cid), db.at(pos).m_Name, db.at(pos).m_Surname, CString(date), CString(street), CString(city)});
+      key = CKeyCodec::ID_TEXT | handle;
       return true;
     }
-    bool print(std::ostream &os, const char id[]) const {
-      CString cid(id);
-      size_t pos = db.lower_bound(cid);
-      if (pos == db.size() || db.at(pos).m_Id != cid) {
+    bool lookupDate(const char date[], uint32_t& key) const {
+      if (CKeyCodec::parseDate(date, key)) {
+        return true;
+      }
+      uint32_t handle;
+      if (!findString(date, handle)) {
         return false;
       }
-      TPerson records[1000];
-      size_t count = 0;
-      while (pos < db.size() && db.at(pos).m_Id == cid) {
-        records[count++] = db.at(pos++);
+      key = CKeyCodec::DATE_TEXT | handle;
+      return true;
+    }
+    uint64_t internId(const char id[]) {
+      uint64_t key;
+      return CKeyCodec::parseId(id, key) ? key : CKeyCodec::ID_TEXT | intern(id);
+    }
+    uint32_t internDate(const char date[]) {
+      uint32_t key;
+      return CKeyCodec::parseDate(date, key) ? key : CKeyCodec::DATE_TEXT | intern(date);
+    }
+    void writeId(std::ostream& os, uint64_t key) const {
+      if (key & CKeyCodec::ID_TEXT) {
+        os << text(key & ~CKeyCodec::ID_TEXT);
+        return;
+      }
+      char buf[CKeyCodec::ID_LENGTH + 1];
+      CKeyCodec::formatId(key, buf);
+      os.write(buf, CKeyCodec::ID_LENGTH);
+    }
+    void writeDate(std::ostream& os, uint32_t key) const {
+      if (key & CKeyCodec::DATE_TEXT) {
+        os << text(key & ~CKeyCodec::DATE_TEXT);
+        return;
       }
-      for (size_t i = 1; i < count; ++i) {
-        TPerson key = records[i];
-        size_t j = i;
-        while (j > 0 && records[j - 1].m_Date > key.m_Date) {
-          records[j] = records[j - 1];
-          --j;
+      char buf[CKeyCodec::DATE_LENGTH + 1];
+      CKeyCodec::formatDate(key, buf);
+      os.write(buf, CKeyCodec::DATE_LENGTH);
+    }
+
+    size_t snapshotLowerBound(const TPerson& probe) const {
+      size_t left = 0, right = recordCount();
+      while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (TPersonLess()(records()[mid], probe)) {
+          left = mid + 1;
+        } else {
+          right = mid;
         }
-        records[j] = key;
       }
-      os << cid << " " << records[0].m_Name << " " << records[0].m_Surname << "\n";
-      for (size_t i = 0; i < count; ++i) {
-        os << records[i].m_Date << " " << records[i].m_Street << " " << records[i].m_City << "\n";
+      return left;
+    }
+    bool snapshotContains(const TPerson& person) const {
+      size_t pos = snapshotLowerBound(person);
+      return pos < recordCount() && !TPersonLess()(person, records()[pos]);
+    }
+    bool deltaContains(const TPerson& person) const {
+      TIndex::CCursor cursor = m_delta.lowerBound(person);
+      return cursor.valid() && !TPersonLess()(person, *cursor);
+    }
+    // oldest record of the person in either part
+    bool first(uint64_t key, TPerson& owner) const {
+      TPerson probe{key, 0, 0, 0, 0, 0};
+      size_t pos = snapshotLowerBound(probe);
+      if (pos < recordCount() && records()[pos].m_Id == key) {
+        owner = records()[pos];
+        return true;
       }
-      return true;
+      TIndex::CCursor cursor = m_delta.lowerBound(probe);
+      if (cursor.valid() && cursor->m_Id == key) {
+        owner = *cursor;
+        return true;
+      }
+      return false;
     }
-  private:
-    Vector db;
 };
 
 #ifndef __PROGTEST__
 int main ()
 {
-  char   lID[12], lDate[12], lName[50], lSurname[50], lStreet[50], lCity[50];
+  char   lID[12], lDate[32], lName[50], lSurname[50], lStreet[50], lCity[50];
   std::ostringstream oss;
   CRegister  a;
   assert ( a . add ( "123456/7890", "John", "Smith", "2000-01-01", "Main street", "Seattle" ) == true );
@@ -339,6 +2367,410 @@ int main ()
 2003-05-12 Elm street Atlanta
 )###" ) );
 
+  CRegister d;
+  assert ( d . add ( "111111/1111", "Bartholomew Alexander", "Montgomery-Fitzgerald", "1999-12-31", "Long Winding Road Number Seven", "San Francisco de Campeche" ) == true );
+  assert ( d . resettle ( "111111/1111", "2005-06-07", "", "X" ) == true );
+  CRegister e ( d );
+  d = c;
+  assert ( e . resettle ( "111111/1111", "2010-01-01", "Another Extremely Long Street Name", "Llanfairpwllgwyngyll" ) == true );
+  oss . str ( "" );
+  assert ( e . print ( oss, "111111/1111" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(111111/1111 Bartholomew Alexander Montgomery-Fitzgerald
+1999-12-31 Long Winding Road Number Seven San Francisco de Campeche
+2005-06-07  X
+2010-01-01 Another Extremely Long Street Name Llanfairpwllgwyngyll
+)###" ) );
+  assert ( d . print ( oss, "111111/1111" ) == false );
+
+  struct TIntLess {
+    bool operator() ( int a, int b ) const { return a < b; }
+  };
+  CBTree<int, TIntLess, 4> tree;
+  for ( int i = 0; i < 1000; ++i )
+    assert ( tree . insert ( i * 7919 % 1000 ) == true );
+  assert ( tree . insert ( 500 ) == false );
+  assert ( tree . size () == 1000 );
+  CBTree<int, TIntLess, 4> treeCopy ( tree );
+  int expected = 0;
+  for ( CBTree<int, TIntLess, 4>::CCursor it = treeCopy . begin (); it . valid (); it . next () )
+    assert ( *it == expected++ );
+  assert ( expected == 1000 );
+  assert ( *tree . lowerBound ( 250 ) == 250 );
+  assert ( ! tree . lowerBound ( 1000 ) . valid () );
+  assert ( treeCopy . insert ( 250 ) == false );
+  assert ( & * tree . lowerBound ( 250 ) == & * treeCopy . lowerBound ( 250 ) );
+  assert ( treeCopy . insert ( 1000 ) == true );
+  assert ( treeCopy . insert ( -1 ) == true );
+  assert ( ! tree . lowerBound ( 1000 ) . valid () );
+  assert ( *tree . begin () == 0 );
+  assert ( *treeCopy . begin () == -1 );
+  assert ( tree . size () == 1000 && treeCopy . size () == 1002 );
+
+  CRegister f;
+  for ( int i = 0; i < 5000; ++i )
+  {
+    snprintf ( lID, sizeof ( lID ), "%06d/%04d", i * 7919 % 5000, 0 );
+    assert ( f . add ( lID, "Jane", "Doe", "2000-01-01", "Main street", "Seattle" ) == true );
+  }
+  assert ( f . add ( "004999/0000", "Jane", "Doe", "2001-01-01", "Main street", "Seattle" ) == false );
+  assert ( f . resettle ( "004999/0000", "2000-01-01", "Elm street", "Atlanta" ) == false );
+  assert ( f . resettle ( "004999/0000", "1999-01-01", "Elm street", "Atlanta" ) == true );
+  assert ( f . resettle ( "005000/0000", "1999-01-01", "Elm street", "Atlanta" ) == false );
+  oss . str ( "" );
+  assert ( f . print ( oss, "004999/0000" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(004999/0000 Jane Doe
+1999-01-01 Elm street Atlanta
+2000-01-01 Main street Seattle
+)###" ) );
+
+  CRegister g ( f );
+  assert ( g . resettle ( "000007/0000", "2020-02-02", "Elm street", "Atlanta" ) == true );
+  assert ( g . add ( "999999/9999", "Jack", "Black", "2001-01-01", "Main street", "Seattle" ) == true );
+  assert ( f . print ( oss, "999999/9999" ) == false );
+  oss . str ( "" );
+  assert ( f . print ( oss, "000007/0000" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), "000007/0000 Jane Doe\n2000-01-01 Main street Seattle\n" ) );
+  oss . str ( "" );
+  assert ( g . print ( oss, "000007/0000" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), "000007/0000 Jane Doe\n2000-01-01 Main street Seattle\n2020-02-02 Elm street Atlanta\n" ) );
+
+  for ( int i = 0; i < 3000; ++i )
+  {
+    snprintf ( lDate, sizeof ( lDate ), "%04d-01-01", 5000 - i );
+    assert ( f . resettle ( "000007/0000", lDate, "Main street", "Seattle" ) == true );
+  }
+  oss . str ( "" );
+  assert ( f . print ( oss, "000007/0000" ) == true );
+  std::string history = oss . str ();
+  assert ( std::count ( history . begin (), history . end (), '\n' ) == 3002 );
+  assert ( history . find ( "000007/0000 Jane Doe\n2000-01-01 Main street Seattle\n2001-01-01" ) == 0 );
+  assert ( history . find ( "4999-01-01 Main street Seattle\n5000-01-01 Main street Seattle\n" ) == history . size () - 62 );
+
+  Vector<CString> strings;
+  strings . push_back ( CString ( "a string long enough to live on the heap" ) );
+  for ( int i = 0; i < 100; ++i )
+    strings . push_back ( strings[0] );
+  strings . emplace_back ( "short" );
+  assert ( strings . size () == 102 && strings . capacity () >= 102 );
+  assert ( ! strcmp ( strings[100] . c_str (), "a string long enough to live on the heap" ) );
+  Vector<CString> stringsCopy ( strings );
+  strings . pop_back ();
+  strings = stringsCopy;
+  assert ( strings . size () == 102 && ! strcmp ( strings . at ( 101 ) . c_str (), "short" ) );
+  Vector<std::string> names;
+  names . reserve ( 3 );
+  const std::string * firstName = names . data ();
+  names . push_back ( "Ann" );
+  names . push_back ( "Bob" );
+  names . push_back ( "Cid" );
+  assert ( names . data () == firstName );
+  for ( int i = 0; i < 50; ++i )
+    names . push_back ( names[i] + "!" );
+  assert ( names . size () == 53 && names[52] == "Bob!!!!!!!!!!!!!!!!!" );
+  Vector<std::string> moved ( std::move ( names ) );
+  assert ( names . size () == 0 && moved . size () == 53 );
+
+  char packed[16];
+  uint64_t packedId;
+  uint32_t packedDate, previousDate = 0;
+  assert ( CKeyCodec::parseId ( "123456/7890", packedId ) && packedId == 1234567890 );
+  CKeyCodec::formatId ( 42, packed );
+  assert ( ! strcmp ( packed, "000000/0042" ) );
+  assert ( ! CKeyCodec::parseId ( "123456-7890", packedId ) );
+  assert ( ! CKeyCodec::parseId ( "123456/78901", packedId ) );
+  assert ( CKeyCodec::parseDate ( "0000-01-01", packedDate ) && packedDate == 0 );
+  assert ( CKeyCodec::parseDate ( "2000-02-29", packedDate ) );
+  assert ( ! CKeyCodec::parseDate ( "1900-02-29", packedDate ) );
+  assert ( ! CKeyCodec::parseDate ( "2000-13-01", packedDate ) );
+  assert ( ! CKeyCodec::parseDate ( "2000-1-01", packedDate ) );
+  for ( int year = 1600; year < 2400; year += 7 )
+    for ( int month = 1; month <= 12; ++month )
+    {
+      snprintf ( lDate, sizeof ( lDate ), "%04u-%02u-28", unsigned ( year ) % 10000, unsigned ( month ) % 100 );
+      assert ( CKeyCodec::parseDate ( lDate, packedDate ) && packedDate > previousDate );
+      previousDate = packedDate;
+      CKeyCodec::formatDate ( packedDate, packed );
+      assert ( ! strcmp ( packed, lDate ) );
+    }
+
+  CRegister h;
+  assert ( h . add ( "X-1", "Odd", "Person", "2000-02-29", "Main street", "Seattle" ) == true );
+  assert ( h . add ( "X-1", "Odd", "Person", "2001-01-01", "Main street", "Seattle" ) == false );
+  assert ( h . resettle ( "X-1", "someday", "Elm street", "Atlanta" ) == true );
+  assert ( h . resettle ( "X-1", "1900-02-29", "Oak street", "Boston" ) == true );
+  assert ( h . resettle ( "X-1", "someday", "Oak street", "Boston" ) == false );
+  assert ( h . resettle ( "X-2", "1999-01-01", "Oak street", "Boston" ) == false );
+  assert ( h . print ( oss, "X-2" ) == false );
+  oss . str ( "" );
+  assert ( h . print ( oss, "X-1" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(X-1 Odd Person
+2000-02-29 Main street Seattle
+someday Elm street Atlanta
+1900-02-29 Oak street Boston
+)###" ) );
+
+  CRegister k;
+  assert ( k . add ( "000001/0000", "Ann", "Lee", "2000-01-01", "Main street", "Seattle" ) == true );
+  TRecord batch[] = {
+    { "000002/0000", "Bob", "Ray", "2005-05-05", "Elm street", "Atlanta" },
+    { "000001/0000", "Ann", "Lee", "1999-01-01", "Oak street", "Boston" },
+    { "000001/0000", "Ann", "Lee", "2000-01-01", "Oak street", "Boston" },
+    { "000001/0000", "Eve", "Lee", "2010-01-01", "Oak street", "Boston" },
+    { "000002/0000", "Bob", "Ray", "2001-01-01", "Main street", "Seattle" },
+    { "000002/0000", "Bob", "Ray", "2001-01-01", "Pine street", "Denver" },
+    { "000002/0000", "Rob", "Ray", "2002-01-01", "Pine street", "Denver" }
+  };
+  CRegister kCopy ( k );
+  assert ( k . bulkLoad ( batch, sizeof ( batch ) / sizeof ( batch[0] ) ) == 3 );
+  oss . str ( "" );
+  assert ( k . print ( oss, "000001/0000" ) == true );
+  assert ( k . print ( oss, "000002/0000" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(000001/0000 Ann Lee
+1999-01-01 Oak street Boston
+2000-01-01 Main street Seattle
+000002/0000 Bob Ray
+2001-01-01 Main street Seattle
+2005-05-05 Elm street Atlanta
+)###" ) );
+  assert ( kCopy . print ( oss, "000002/0000" ) == false );
+  assert ( k . resettle ( "000002/0000", "2003-03-03", "Pine street", "Denver" ) == true );
+
+  const int BULK = 200000;
+  std::string * bulkIds = new std::string[BULK];
+  TRecord * bulk = new TRecord[BULK];
+  for ( int i = 0; i < BULK; ++i )
+  {
+    snprintf ( lID, sizeof ( lID ), "%06d/%04d", i * 7919 % ( BULK / 2 ), 0 );
+    bulkIds[i] = lID;
+    bulk[i] = TRecord { bulkIds[i] . c_str (), "Jane", "Doe", i < BULK / 2 ? "2000-01-01" : "2001-01-01", "Main street", "Seattle" };
+  }
+  CRegister m;
+  assert ( m . bulkLoad ( bulk, BULK, 4 ) == BULK );
+  assert ( m . bulkLoad ( bulk, BULK, 4 ) == 0 );
+  oss . str ( "" );
+  assert ( m . print ( oss, "099999/0000" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), "099999/0000 Jane Doe\n2000-01-01 Main street Seattle\n2001-01-01 Main street Seattle\n" ) );
+  assert ( m . add ( "100000/0000", "Jane", "Doe", "2000-01-01", "Main street", "Seattle" ) == true );
+  assert ( m . add ( "050000/0000", "Jane", "Doe", "2000-01-01", "Main street", "Seattle" ) == false );
+  delete [] bulk;
+  delete [] bulkIds;
+
+  char storeDir[] = "/tmp/du2storeXXXXXX";
+  assert ( mkdtemp ( storeDir ) );
+  std::string storePath = std::string ( storeDir ) + "/register";
+  {
+    CRegisterStore store;
+    assert ( store . open ( storePath . c_str () ) );
+    assert ( store . add ( "123456/7890", "John", "Smith", "2000-01-01", "Main street", "Seattle" ) == true );
+    assert ( store . add ( "987654/3210", "Freddy", "Kruger", "2001-02-03", "Elm street", "Sacramento" ) == true );
+    assert ( store . resettle ( "123456/7890", "2003-05-12", "Elm street", "Atlanta" ) == true );
+    assert ( store . resettle ( "123456/7890", "2003-05-12", "Oak street", "Boston" ) == false );
+  }
+  {
+    CRegisterStore store;
+    assert ( store . open ( storePath . c_str () ) );
+    assert ( store . size () == 3 );
+    assert ( store . add ( "123456/7890", "John", "Smith", "2009-01-01", "Main street", "Seattle" ) == false );
+    assert ( store . compact () );
+    assert ( store . resettle ( "123456/7890", "2002-12-05", "Sunset boulevard", "Los Angeles" ) == true );
+    assert ( store . resettle ( "123456/7890", "2000-01-01", "Sunset boulevard", "Los Angeles" ) == false );
+    assert ( store . add ( "X-1", "Odd", "Person", "someday", "Tiny street", "Seattle" ) == true );
+  }
+  {
+    // a torn entry at the end of the log is dropped
+    FILE * log = fopen ( ( storePath + ".log" ) . c_str (), "ab" );
+    assert ( log && fwrite ( "\x40\0\0\0A", 1, 5, log ) == 5 && fclose ( log ) == 0 );
+    CRegisterStore store;
+    assert ( store . open ( storePath . c_str () ) );
+    assert ( store . size () == 5 );
+    oss . str ( "" );
+    assert ( store . print ( oss, "123456/7890" ) == true );
+    assert ( store . print ( oss, "X-1" ) == true );
+    assert ( store . print ( oss, "X-2" ) == false );
+    assert ( ! strcmp ( oss . str () . c_str (), R"###(123456/7890 John Smith
+2000-01-01 Main street Seattle
+2002-12-05 Sunset boulevard Los Angeles
+2003-05-12 Elm street Atlanta
+X-1 Odd Person
+someday Tiny street Seattle
+)###" ) );
+    assert ( store . compact () );
+    assert ( store . resettle ( "X-1", "2020-01-01", "Main street", "Seattle" ) == true );
+  }
+  {
+    CRegisterStore store;
+    assert ( store . open ( storePath . c_str () ) );
+    oss . str ( "" );
+    assert ( store . print ( oss, "X-1" ) == true );
+    assert ( ! strcmp ( oss . str () . c_str (), "X-1 Odd Person\n2020-01-01 Main street Seattle\nsomeday Tiny street Seattle\n" ) );
+  }
+  {
+    // record padding goes to the disk zeroed, a slot outside the string table
+    // makes the snapshot invalid
+    CRegisterStore store;
+    assert ( store . open ( storePath . c_str () ) && store . compact () );
+    store . close ();
+    std::ifstream in ( storePath + ".snap", std::ios::binary );
+    std::string snapshot ( ( std::istreambuf_iterator<char> ( in ) ), std::istreambuf_iterator<char> () );
+    uint64_t recordCount, stringCount, slotsOffset;
+    memcpy ( &recordCount, snapshot . data () + 8, sizeof ( recordCount ) );
+    memcpy ( &stringCount, snapshot . data () + 16, sizeof ( stringCount ) );
+    memcpy ( &slotsOffset, snapshot . data () + 56, sizeof ( slotsOffset ) );
+    assert ( recordCount == 6 );
+    // the strings of a rejected move are never interned
+    assert ( snapshot . find ( "Oak street" ) == std::string::npos && snapshot . find ( "Boston" ) == std::string::npos );
+    for ( size_t i = 0; i < recordCount; ++i )
+      for ( size_t j = offsetof ( TPerson, m_City ) + sizeof ( uint32_t ); j < sizeof ( TPerson ); ++j )
+        assert ( snapshot[4096 + i * sizeof ( TPerson ) + j] == 0 );
+    std::string damaged = snapshot;
+    uint32_t badSlot = stringCount;
+    memcpy ( &damaged[slotsOffset], &badSlot, sizeof ( badSlot ) );
+    std::ofstream ( storePath + ".snap", std::ios::binary | std::ios::trunc ) << damaged;
+    assert ( ! store . open ( storePath . c_str () ) );
+    std::ofstream ( storePath + ".snap", std::ios::binary | std::ios::trunc ) << snapshot;
+    assert ( store . open ( storePath . c_str () ) && store . size () == 6 );
+  }
+  unlink ( ( storePath + ".snap" ) . c_str () );
+  unlink ( ( storePath + ".log" ) . c_str () );
+  rmdir ( storeDir );
+
+  CRegister q;
+  assert ( q . add ( "000001/0000", "Ann", "Lee", "2000-01-01", "Elm street", "Seattle" ) == true );
+  assert ( q . add ( "000002/0000", "Bob", "Ray", "2000-01-01", "Main street", "Seattle" ) == true );
+  assert ( q . add ( "000003/0000", "Cid", "Lee", "2005-01-01", "Elm street", "Atlanta" ) == true );
+  assert ( q . resettle ( "000001/0000", "2010-01-01", "Elm street", "Atlanta" ) == true );
+  assert ( q . resettle ( "000003/0000", "2012-01-01", "Main street", "Seattle" ) == true );
+  oss . str ( "" );
+  assert ( q . residents ( oss, "Seattle" ) == 2 );
+  assert ( ! strcmp ( oss . str () . c_str (), "000002/0000 Bob Ray\n000003/0000 Cid Lee\n" ) );
+  oss . str ( "" );
+  assert ( q . residents ( oss, "Seattle", "Elm street", nullptr, "2009-12-31" ) == 1 );
+  assert ( ! strcmp ( oss . str () . c_str (), "000001/0000 Ann Lee\n" ) );
+  oss . str ( "" );
+  assert ( q . residents ( oss, nullptr, "Elm street", "Lee", "2011-01-01" ) == 2 );
+  assert ( ! strcmp ( oss . str () . c_str (), "000001/0000 Ann Lee\n000003/0000 Cid Lee\n" ) );
+  assert ( q . residents ( oss, "Atlanta", nullptr, nullptr, "1999-01-01" ) == 0 );
+  assert ( q . residents ( oss, "Boston" ) == 0 );
+  assert ( q . residents ( oss, nullptr ) == 0 );
+  CRegister qCopy ( q );
+  assert ( qCopy . resettle ( "000002/0000", "2020-01-01", "Elm street", "Atlanta" ) == true );
+  assert ( qCopy . residents ( oss, "Atlanta" ) == 2 );
+  assert ( q . residents ( oss, "Atlanta" ) == 1 );
+  oss . str ( "" );
+  assert ( q . addressAt ( oss, "000001/0000", "2009-12-31" ) == true );
+  assert ( q . addressAt ( oss, "000001/0000", "2010-01-01" ) == true );
+  assert ( q . addressAt ( oss, "000001/0000", "1999-12-31" ) == false );
+  assert ( q . addressAt ( oss, "000009/0000", "2009-12-31" ) == false );
+  assert ( ! strcmp ( oss . str () . c_str (), "2000-01-01 Elm street Seattle\n2010-01-01 Elm street Atlanta\n" ) );
+  assert ( q . resettle ( "000002/0000", "2015-01-01", "Elm street", "Seattle" ) == true );
+  oss . str ( "" );
+  assert ( q . movedInto ( oss, "Seattle", "2000-01-01", "2020-01-01" ) == 3 );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(2000-01-01 000001/0000 Ann Lee
+2000-01-01 000002/0000 Bob Ray
+2012-01-01 000003/0000 Cid Lee
+)###" ) );
+  assert ( q . movedInto ( oss, "Seattle", "2013-01-01", "2020-01-01" ) == 0 );
+  oss . str ( "" );
+  assert ( q . movedInto ( oss, "Atlanta", "2006-01-01", "2011-01-01" ) == 1 );
+  assert ( ! strcmp ( oss . str () . c_str (), "2010-01-01 000001/0000 Ann Lee\n" ) );
+  assert ( m . movedInto ( oss, "Seattle", "2001-01-01", "2001-01-01" ) == 0 );
+  assert ( q . add ( "000004/0000", "Dan", "Fox", "someday", "Elm street", "Seattle" ) == true );
+  assert ( q . add ( "000005/0000", "Eve", "Fox", "anyday", "Elm street", "Seattle" ) == true );
+  oss . str ( "" );
+  assert ( q . movedInto ( oss, "Seattle", "someday", "someday" ) == 0 );
+  assert ( q . movedInto ( oss, "Seattle", "2000-01-01", "someday" ) == 0 );
+  assert ( q . movedInto ( oss, "Seattle", "anyday", "2020-01-01" ) == 0 );
+  assert ( q . movedInto ( oss, "Seattle", "2000-01-01", "2020-01-01" ) == 3 );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(2000-01-01 000001/0000 Ann Lee
+2000-01-01 000002/0000 Bob Ray
+2012-01-01 000003/0000 Cid Lee
+)###" ) );
+  assert ( m . residents ( oss, "Seattle", "Main street", "Doe" ) == BULK / 2 + 1 );
+
+  CShardedRegister sharded ( 4 );
+  std::thread writers[4];
+  for ( int t = 0; t < 4; ++t )
+    writers[t] = std::thread ( [&sharded, t] {
+      char id[24];
+      for ( int i = t; i < 2000; i += 4 )
+      {
+        snprintf ( id, sizeof ( id ), "%06d/0000", i );
+        assert ( sharded . add ( id, "Jane", "Doe", "2000-01-01", "Main street", i % 2 ? "Seattle" : "Atlanta" ) );
+      }
+    } );
+  for ( std::thread & writer : writers )
+    writer . join ();
+  assert ( sharded . add ( "000007/0000", "Jane", "Doe", "2001-01-01", "Main street", "Seattle" ) == false );
+  assert ( sharded . resettle ( "000007/0000", "2001-01-01", "Elm street", "Atlanta" ) == true );
+  oss . str ( "" );
+  assert ( sharded . print ( oss, "000007/0000" ) == true );
+  assert ( sharded . addressAt ( oss, "000007/0000", "2000-06-01" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), R"###(000007/0000 Jane Doe
+2000-01-01 Main street Seattle
+2001-01-01 Elm street Atlanta
+2000-01-01 Main street Seattle
+)###" ) );
+  oss . str ( "" );
+  assert ( sharded . residents ( oss, "Seattle", nullptr, nullptr, nullptr, 3 ) == 999 );
+  std::string seattle = oss . str ();
+  assert ( seattle . find ( "000001/0000 Jane Doe\n000003/0000 Jane Doe\n000005/0000 Jane Doe\n000009/0000" ) == 0 );
+  oss . str ( "" );
+  assert ( sharded . movedInto ( oss, "Atlanta", "2000-06-01", "2002-01-01" ) == 1 );
+  assert ( ! strcmp ( oss . str () . c_str (), "2001-01-01 000007/0000 Jane Doe\n" ) );
+  CShardedRegister shardedBulk ( 3 );
+  assert ( shardedBulk . bulkLoad ( batch, sizeof ( batch ) / sizeof ( batch[0] ), 2 ) == 4 );
+  oss . str ( "" );
+  assert ( shardedBulk . print ( oss, "000002/0000" ) == true );
+  assert ( ! strcmp ( oss . str () . c_str (), "000002/0000 Bob Ray\n2001-01-01 Main street Seattle\n2005-05-05 Elm street Atlanta\n" ) );
+
+  CConcurrentRegister shared;
+  assert ( shared . add ( "123456/7890", "John", "Smith", "2000-01-01", "Main street", "Seattle" ) == true );
+  assert ( shared . add ( "X-1", "Odd", "Person", "2000-01-01", "Main street", "Seattle" ) == true );
+  std::atomic<bool> readersOk ( true );
+  std::thread readers[3];
+  for ( std::thread & reader : readers )
+    reader = std::thread ( [&] {
+      size_t seen = 0;
+      for ( int i = 0; i < 2000; ++i )
+      {
+        std::ostringstream out;
+        if ( ! shared . print ( out, i % 2 ? "123456/7890" : "X-1" ) )
+          readersOk = false;
+        std::string text = out . str ();
+        size_t lines = std::count ( text . begin (), text . end (), '\n' );
+        // histories only grow, a reader never sees an older version again
+        if ( i % 2 && lines < seen )
+          readersOk = false;
+        if ( i % 2 )
+          seen = lines;
+      }
+    } );
+  for ( int i = 0; i < 500; ++i )
+  {
+    snprintf ( lDate, sizeof ( lDate ), "%04d-01-01", 2001 + i );
+    assert ( shared . resettle ( "123456/7890", lDate, "Elm street", "Atlanta" ) == true );
+    snprintf ( lCity, sizeof ( lCity ), "City %d", i );
+    assert ( shared . resettle ( "X-1", lDate, "Oak street", lCity ) == true );
+  }
+  for ( std::thread & reader : readers )
+    reader . join ();
+  assert ( readersOk );
+  oss . str ( "" );
+  assert ( shared . print ( oss, "X-1" ) == true );
+  assert ( oss . str () . find ( "2500-01-01 Oak street City 499\n" ) != std::string::npos );
+
+  CStringPool pool;
+  uint32_t hSeattle = pool . intern ( "Seattle" );
+  assert ( pool . intern ( "Atlanta" ) != hSeattle );
+  assert ( pool . intern ( "Seattle" ) == hSeattle );
+  for ( int i = 0; i < 1000; ++i )
+    pool . intern ( std::to_string ( i ) . c_str () );
+  assert ( pool . size () == 1002 );
+  assert ( pool . intern ( "Seattle" ) == hSeattle );
+  CStringPool poolCopy ( pool );
+  assert ( poolCopy . intern ( "500" ) == pool . intern ( "500" ) );
+  assert ( ! strcmp ( poolCopy . get ( hSeattle ) . c_str (), "Seattle" ) );
+
   return EXIT_SUCCESS;
 }
 #endif /* __PROGTEST__ */
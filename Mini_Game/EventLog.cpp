@@ -0,0 +1,53 @@
+#include "EventLog.h"
+#include <cstring>
+
+bool EventLog::push(EventType type, int value, const char* name) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    GameEvent& event = buffer[t & (CAPACITY - 1)];
+    event.type = type;
+    event.value = value;
+    std::strncpy(event.name, name, sizeof(event.name) - 1);
+    event.name[sizeof(event.name) - 1] = '\0';
+
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+bool EventLog::pop(GameEvent& event) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+        return false;
+
+    event = buffer[h & (CAPACITY - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+size_t EventLog::getDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void EventLog::print(std::ostream& os, const GameEvent& event) {
+    switch (event.type) {
+        case EventType::PlayerAttack:
+            os << "You hit the enemy for " << event.value << " damage!\n";
+            break;
+        case EventType::EnemyAttack:
+            os << "Enemy hits you!\n";
+            break;
+        case EventType::Heal:
+            os << "Picked up " << event.name << "! +" << event.value << " HP.\n";
+            break;
+        case EventType::WeaponUpgrade:
+            os << "Picked up " << event.name << "! Damage +" << event.value << "!\n";
+            break;
+        case EventType::Trap:
+            os << "A trap! -" << event.value << " HP.\n";
+            break;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+
+enum class EventType {
+    PlayerAttack,
+    EnemyAttack,
+    Heal,
+    WeaponUpgrade,
+    Trap
+};
+
+struct GameEvent {
+    EventType type;
+    int value;
+    char name[24];   // item name, truncated; empty for other events
+};
+
+// Single-producer/single-consumer ring buffer. The simulation pushes typed
+// events without formatting them; the renderer pops and prints them later.
+class EventLog {
+private:
+    static const size_t CAPACITY = 256;   // power of two
+
+    GameEvent buffer[CAPACITY];
+    std::atomic<size_t> head{0};   // next slot to read
+    std::atomic<size_t> tail{0};   // next slot to write
+    std::atomic<size_t> dropped{0};
+
+public:
+    bool push(EventType type, int value, const char* name = "");
+    bool pop(GameEvent& event);
+    size_t getDropped() const;
+
+    static void print(std::ostream& os, const GameEvent& event);
+};
@@ -26,6 +26,11 @@ void Game::run() {
         clearScreen();
         map.render();
 
+        GameEvent event;
+        while (map.getEvents().pop(event)) {
+            EventLog::print(std::cout, event);
+        }
+
         if (!player->isAlive()) {
             std::cout << "You died!\n";
             break;
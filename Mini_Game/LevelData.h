@@ -2,6 +2,7 @@
 #include <vector>
 #include "Enemy.h"
 #include "Item.h"
+#include "Trigger.h"
 
 struct LevelData {
     int width;
@@ -11,4 +12,5 @@ struct LevelData {
     std::vector<Item> items;
     std::pair<int, int> playerStart;
     std::pair<int, int> exitPosition;
+    std::vector<Trigger> triggers;
 };
@@ -6,14 +6,14 @@
 Map::Map(int width, int height)
     : width(width), height(height), grid(height, std::vector<char>(width, ' ')) {}
 
-    
-int exitX, exitY;
+
 void Map::loadLevel(const LevelData& data, std::shared_ptr<Player> existingPlayer) {
     width = data.width;
     height = data.height;
     grid.assign(height, std::vector<char>(width, ' '));
     items = data.items;
     enemies.clear();
+    triggers.clear();
     for (int x = 0; x < width; ++x) {
         grid[0][x] = '#';            
         grid[height - 1][x] = '#';    
@@ -30,9 +30,10 @@ void Map::loadLevel(const LevelData& data, std::shared_ptr<Player> existingPlaye
         enemies.push_back(std::make_shared<Enemy>(pos.first, pos.second));
     }
 
-    exitX = data.exitPosition.first;
-    exitY = data.exitPosition.second;
-    grid[exitY][exitX] = 'X';
+    addTrigger(Trigger{data.exitPosition.first, data.exitPosition.second, TriggerType::Exit});
+    for (const auto& trigger : data.triggers) {
+        addTrigger(trigger);
+    }
 
     if (existingPlayer) {
         player = existingPlayer;
@@ -40,23 +41,68 @@ void Map::loadLevel(const LevelData& data, std::shared_ptr<Player> existingPlaye
     } else {
         player = std::make_shared<Player>(data.playerStart.first, data.playerStart.second);
     }
+
+    pathfinder.build(*this);
+}
+
+int Map::getWidth() const {
+    return width;
+}
+
+int Map::getHeight() const {
+    return height;
+}
+
+int Map::tileKey(int x, int y) const {
+    return y * width + x;
+}
+
+void Map::addTrigger(const Trigger& trigger) {
+    // levels without an exit mark it with an off-map position
+    if (trigger.x < 0 || trigger.y < 0 || trigger.x >= width || trigger.y >= height)
+        return;
+
+    triggers[tileKey(trigger.x, trigger.y)] = trigger;
+    if (trigger.type == TriggerType::Exit)
+        grid[trigger.y][trigger.x] = 'X';
+    else if (trigger.type == TriggerType::Teleport)
+        grid[trigger.y][trigger.x] = 'O';
+}
+
+const Trigger* Map::getTriggerAt(int x, int y) const {
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return nullptr;
+    auto it = triggers.find(tileKey(x, y));
+    return it == triggers.end() ? nullptr : &it->second;
 }
+
 bool Map::isExitReached() const {
-    return player->getX() == exitX && player->getY() == exitY;
+    const Trigger* trigger = getTriggerAt(player->getX(), player->getY());
+    return trigger && trigger->type == TriggerType::Exit;
 }
 
+void Map::checkForTrigger() {
+    const Trigger* trigger = getTriggerAt(player->getX(), player->getY());
+    if (!trigger) return;
+
+    if (trigger->type == TriggerType::Trap) {
+        events.push(EventType::Trap, trigger->value);
+        player->takeDamage(trigger->value);
+    } else if (trigger->type == TriggerType::Teleport && isWalkable(trigger->targetX, trigger->targetY)) {
+        player->setPosition(trigger->targetX, trigger->targetY);
+        checkForItemPickup();
+    }
+}
 
 void Map::checkForItemPickup() {
     auto it = items.begin();
     while (it != items.end()) {
         if (it->getX() == player->getX() && it->getY() == player->getY()) {
-            std::cout << "Picked up " << it->getName() << "! ";
-
             if (it->getType() == ItemType::Heal) {
-                std::cout << "+" << it->getValue() << " HP.\n";
+                events.push(EventType::Heal, it->getValue(), it->getName().c_str());
                 player->takeDamage(-it->getValue());
             } else if (it->getType() == ItemType::Weapon) {
-                std::cout << "Damage +" << it->getValue() << "!\n";
+                events.push(EventType::WeaponUpgrade, it->getValue(), it->getName().c_str());
                 player->increaseDamage(it->getValue());
             }
 
@@ -114,10 +160,24 @@ std::vector<std::shared_ptr<Enemy>>& Map::getEnemies() {
     return enemies;
 }
 
+EventLog& Map::getEvents() {
+    return events;
+}
+
 bool Map::isWalkable(int x, int y) const {
     if (x <= 0 || y <= 0 || x >= width - 1 || y >= height - 1)
         return false;
-    return grid[y][x] == ' ' || grid[y][x] == 'X';
+    return grid[y][x] != '#';
+}
+
+void Map::setWall(int x, int y, bool wall) {
+    if (x <= 0 || y <= 0 || x >= width - 1 || y >= height - 1)
+        return;
+    if (wall)
+        grid[y][x] = '#';
+    else if (grid[y][x] == '#')
+        grid[y][x] = ' ';
+    pathfinder.rebuildAround(*this, x, y);
 }
 
 void Map::movePlayer(int dx, int dy) {
@@ -127,7 +187,7 @@ void Map::movePlayer(int dx, int dy) {
     for (auto& enemy : enemies) {
         if (enemy->isAlive() && enemy->getX() == newX && enemy->getY() == newY) {
             enemy->takeDamage(player->getDamage());
-            std::cout << "You hit the enemy for " << player->getDamage() << " damage!\n";
+            events.push(EventType::PlayerAttack, player->getDamage());
             return;
         }
     }
@@ -135,6 +195,7 @@ void Map::movePlayer(int dx, int dy) {
     if (isWalkable(newX, newY)) {
         player->setPosition(newX, newY);
         checkForItemPickup();
+        checkForTrigger();
     }
 }
 
@@ -148,10 +209,12 @@ void Map::updateEnemies() {
         int distY = abs(enemy->getY() - player->getY());
 
         if (distX + distY <= 5) {
-            if (enemy->getX() < player->getX()) dx = 1;
-            else if (enemy->getX() > player->getX()) dx = -1;
-            if (enemy->getY() < player->getY()) dy = 1;
-            else if (enemy->getY() > player->getY()) dy = -1;
+            if (!pathfinder.nextStep(*this, enemy->getX(), enemy->getY(), player->getX(), player->getY(), dx, dy)) {
+                if (enemy->getX() < player->getX()) dx = 1;
+                else if (enemy->getX() > player->getX()) dx = -1;
+                if (enemy->getY() < player->getY()) dy = 1;
+                else if (enemy->getY() > player->getY()) dy = -1;
+            }
         } else {
             dx = enemy->getDirX();
             dy = enemy->getDirY();
@@ -162,7 +225,7 @@ void Map::updateEnemies() {
 
         if (newX == player->getX() && newY == player->getY()) {
             player->takeDamage(1);
-            std::cout << "Enemy hits you!\n";
+            events.push(EventType::EnemyAttack, 1);
         } else if (isWalkable(newX, newY)) {
             enemy->setPosition(newX, newY);
         } else {
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
 #include <memory>
 #include "Player.h"
 #include "Enemy.h"
 #include "Item.h"
 #include "LevelData.h"
+#include "Trigger.h"
+#include "Pathfinder.h"
+#include "EventLog.h"
 
 class Map {
 private:
@@ -16,23 +20,34 @@ private:
     std::shared_ptr<Player> player;
     std::vector<std::shared_ptr<Enemy>> enemies;
     std::vector<Item> items;
+    std::unordered_map<int, Trigger> triggers;
+    Pathfinder pathfinder;
+    EventLog events;
 
 public:
     Map(int width, int height);
 
     void initialize();
+    int getWidth() const;
+    int getHeight() const;
     void render() const;
 
     std::shared_ptr<Player> getPlayer();
     std::vector<std::shared_ptr<Enemy>>& getEnemies();
+    EventLog& getEvents();
     void loadLevel(const LevelData& data, std::shared_ptr<Player> existingPlayer = nullptr);
     bool isExitReached() const;
     bool areAllEnemiesDefeated() const;
     bool isWalkable(int x, int y) const;
+    void setWall(int x, int y, bool wall);
     void movePlayer(int dx, int dy);
     void updateEnemies();
     void checkForItemPickup();
+    void checkForTrigger();
+    const Trigger* getTriggerAt(int x, int y) const;
 
 private:
     void placeStaticObjects();
+    void addTrigger(const Trigger& trigger);
+    int tileKey(int x, int y) const;
 };
@@ -0,0 +1,509 @@
+#include "Pathfinder.h"
+#include "Map.h"
+#include <functional>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace {
+const int DIRS[8][2] = {
+    {1, 0}, {-1, 0}, {0, 1}, {0, -1},
+    {1, 1}, {1, -1}, {-1, 1}, {-1, -1}
+};
+
+// entrances at least this wide get a transition at both ends
+const int WIDE_ENTRANCE = 6;
+
+int chebyshev(int x1, int y1, int x2, int y2) {
+    return std::max(std::abs(x1 - x2), std::abs(y1 - y2));
+}
+}
+
+Pathfinder::Pathfinder(int clusterSize)
+    : clusterSize(clusterSize), routeCache(ROUTE_CACHE_SIZE) {}
+
+int Pathfinder::clusterOf(int x, int y) const {
+    return (y / clusterSize) * clustersX + x / clusterSize;
+}
+
+void Pathfinder::clusterBounds(int cluster, int& x0, int& y0, int& x1, int& y1) const {
+    x0 = (cluster % clustersX) * clusterSize;
+    y0 = (cluster / clustersX) * clusterSize;
+    x1 = std::min(x0 + clusterSize, width) - 1;
+    y1 = std::min(y0 + clusterSize, height) - 1;
+}
+
+int Pathfinder::addNode(int x, int y) {
+    int id;
+    if (!freeNodes.empty()) {
+        id = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        id = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+    }
+    Node& node = nodes[id];
+    node.x = x;
+    node.y = y;
+    node.cluster = clusterOf(x, y);
+    node.partner = -1;
+    node.edges.clear();
+    node.alive = true;
+    clusterNodes[node.cluster].push_back(id);
+    return id;
+}
+
+void Pathfinder::removeNode(int id) {
+    Node& node = nodes[id];
+    auto& list = clusterNodes[node.cluster];
+    list.erase(std::remove(list.begin(), list.end(), id), list.end());
+    node.alive = false;
+    node.edges.clear();
+    freeNodes.push_back(id);
+}
+
+void Pathfinder::build(const Map& map) {
+    width = map.getWidth();
+    height = map.getHeight();
+    clustersX = (width + clusterSize - 1) / clusterSize;
+    clustersY = (height + clusterSize - 1) / clusterSize;
+    nodes.clear();
+    freeNodes.clear();
+    clusterNodes.assign(clustersX * clustersY, {});
+
+    for (int cy = 0; cy < clustersY; ++cy) {
+        for (int cx = 0; cx < clustersX; ++cx) {
+            int cluster = cy * clustersX + cx;
+            if (cx + 1 < clustersX) buildBorder(map, cluster, cluster + 1);
+            if (cy + 1 < clustersY) buildBorder(map, cluster, cluster + clustersX);
+            if (cx + 1 < clustersX && cy + 1 < clustersY) buildCorner(map, cluster);
+        }
+    }
+    for (int cluster = 0; cluster < clustersX * clustersY; ++cluster) {
+        buildIntraEdges(map, cluster);
+    }
+
+    // sized once here instead of in the first query
+    searchStamp.assign(nodes.size(), 0);
+    goalStamp.assign(nodes.size(), 0);
+    bestCost.resize(nodes.size());
+    cameFrom.resize(nodes.size());
+    goalCost.resize(nodes.size());
+    ++version;
+}
+
+void Pathfinder::rebuildAround(const Map& map, int x, int y) {
+    if (x < 0 || y < 0 || x >= width || y >= height) return;
+    ++version;
+
+    int cluster = clusterOf(x, y);
+    int cx = cluster % clustersX;
+    int cy = cluster / clustersX;
+
+    std::vector<int> touched = {cluster};
+    if (cx > 0) touched.push_back(cluster - 1);
+    if (cx + 1 < clustersX) touched.push_back(cluster + 1);
+    if (cy > 0) touched.push_back(cluster - clustersX);
+    if (cy + 1 < clustersY) touched.push_back(cluster + clustersX);
+
+    for (size_t i = 1; i < touched.size(); ++i) {
+        int a = std::min(cluster, touched[i]);
+        int b = std::max(cluster, touched[i]);
+        clearBorder(a, b);
+        buildBorder(map, a, b);
+    }
+
+    // the four corners of the cluster, each named by the cluster above and
+    // left of it; a corner crossing changes the nodes of all four clusters
+    // meeting there, so the diagonal neighbours need new edges too
+    for (int oy = -1; oy <= 0; ++oy) {
+        for (int ox = -1; ox <= 0; ++ox) {
+            int kx = cx + ox, ky = cy + oy;
+            if (kx < 0 || ky < 0 || kx + 1 >= clustersX || ky + 1 >= clustersY) continue;
+            int corner = ky * clustersX + kx;
+            clearBorder(corner, corner + clustersX + 1);
+            clearBorder(corner + 1, corner + clustersX);
+            buildCorner(map, corner);
+        }
+    }
+    for (int oy = -1; oy <= 1; oy += 2) {
+        for (int ox = -1; ox <= 1; ox += 2) {
+            if (cx + ox >= 0 && cx + ox < clustersX && cy + oy >= 0 && cy + oy < clustersY)
+                touched.push_back(cluster + oy * clustersX + ox);
+        }
+    }
+    for (int c : touched) {
+        buildIntraEdges(map, c);
+    }
+}
+
+// a step from (ax, ay) to the diagonal (bx, by) that no straight step can
+// replace: both tiles of the elbow are walls
+bool Pathfinder::diagonalOnly(const Map& map, int ax, int ay, int bx, int by) const {
+    return map.isWalkable(ax, ay) && map.isWalkable(bx, by)
+        && !map.isWalkable(ax, by) && !map.isWalkable(bx, ay);
+}
+
+void Pathfinder::connect(int ax, int ay, int bx, int by) {
+    int a = addNode(ax, ay);
+    int b = addNode(bx, by);
+    nodes[a].partner = b;
+    nodes[b].partner = a;
+}
+
+// clusterB is the right or bottom neighbour of clusterA
+void Pathfinder::buildBorder(const Map& map, int clusterA, int clusterB) {
+    int ax0, ay0, ax1, ay1;
+    clusterBounds(clusterA, ax0, ay0, ax1, ay1);
+    bool vertical = (clusterB == clusterA + 1);
+
+    int length = vertical ? ay1 - ay0 + 1 : ax1 - ax0 + 1;
+    auto open = [&](int i) {
+        if (vertical)
+            return map.isWalkable(ax1, ay0 + i) && map.isWalkable(ax1 + 1, ay0 + i);
+        return map.isWalkable(ax0 + i, ay1) && map.isWalkable(ax0 + i, ay1 + 1);
+    };
+    auto across = [&](int i, int j) {
+        if (vertical)
+            connect(ax1, ay0 + i, ax1 + 1, ay0 + j);
+        else
+            connect(ax0 + i, ay1, ax0 + j, ay1 + 1);
+    };
+    auto diagonal = [&](int i, int j) {
+        if (vertical)
+            return diagonalOnly(map, ax1, ay0 + i, ax1 + 1, ay0 + j);
+        return diagonalOnly(map, ax0 + i, ay1, ax0 + j, ay1 + 1);
+    };
+
+    int i = 0;
+    while (i < length) {
+        if (!open(i)) {
+            ++i;
+            continue;
+        }
+        int start = i;
+        while (i < length && open(i)) ++i;
+        int end = i - 1;
+        if (end - start + 1 >= WIDE_ENTRANCE) {
+            across(start, start);
+            across(end, end);
+        } else {
+            across((start + end) / 2, (start + end) / 2);
+        }
+    }
+
+    // enemies also cross diagonally; where a wall blocks both straight
+    // crossings next to such a step it needs an entrance of its own
+    for (i = 0; i + 1 < length; ++i) {
+        if (diagonal(i, i + 1)) across(i, i + 1);
+        if (diagonal(i + 1, i)) across(i + 1, i);
+    }
+}
+
+// both diagonal crossings of the point where cluster, its right neighbour
+// and the two clusters below them meet
+void Pathfinder::buildCorner(const Map& map, int cluster) {
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, x0, y0, x1, y1);
+    if (diagonalOnly(map, x1, y1, x1 + 1, y1 + 1)) connect(x1, y1, x1 + 1, y1 + 1);
+    if (diagonalOnly(map, x1 + 1, y1, x1, y1 + 1)) connect(x1 + 1, y1, x1, y1 + 1);
+}
+
+void Pathfinder::clearBorder(int clusterA, int clusterB) {
+    std::vector<int> doomed;
+    for (int id : clusterNodes[clusterA]) {
+        int partner = nodes[id].partner;
+        if (partner >= 0 && nodes[partner].cluster == clusterB) {
+            doomed.push_back(id);
+            doomed.push_back(partner);
+        }
+    }
+    for (int id : doomed) {
+        removeNode(id);
+    }
+}
+
+void Pathfinder::buildIntraEdges(const Map& map, int cluster) {
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, x0, y0, x1, y1);
+    int clusterWidth = x1 - x0 + 1;
+
+    for (int id : clusterNodes[cluster]) {
+        Node& node = nodes[id];
+        node.edges.clear();
+        localSearch(map, cluster, node.x, node.y);
+        for (int other : clusterNodes[cluster]) {
+            if (other == id) continue;
+            int d = localDist[(nodes[other].y - y0) * clusterWidth + (nodes[other].x - x0)];
+            if (d != INT_MAX) node.edges.push_back({other, d});
+        }
+    }
+}
+
+// BFS restricted to one cluster into localDist and localParent;
+// enemies move in 8 directions at unit cost
+void Pathfinder::localSearch(const Map& map, int cluster, int startX, int startY) const {
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, x0, y0, x1, y1);
+    int clusterWidth = x1 - x0 + 1;
+    int clusterHeight = y1 - y0 + 1;
+
+    localDist.assign(clusterWidth * clusterHeight, INT_MAX);
+    localParent.assign(clusterWidth * clusterHeight, -1);
+    localQueue.clear();
+
+    int start = (startY - y0) * clusterWidth + (startX - x0);
+    localDist[start] = 0;
+    localQueue.push_back(start);
+
+    for (size_t head = 0; head < localQueue.size(); ++head) {
+        int current = localQueue[head];
+        int cx = x0 + current % clusterWidth;
+        int cy = y0 + current / clusterWidth;
+        for (const auto& dir : DIRS) {
+            int nx = cx + dir[0];
+            int ny = cy + dir[1];
+            if (nx < x0 || ny < y0 || nx > x1 || ny > y1) continue;
+            int next = (ny - y0) * clusterWidth + (nx - x0);
+            if (localDist[next] != INT_MAX || !map.isWalkable(nx, ny)) continue;
+            localDist[next] = localDist[current] + 1;
+            localParent[next] = current;
+            localQueue.push_back(next);
+        }
+    }
+}
+
+// appends the local path (excluding its first tile) inside the cluster of (fromX, fromY)
+bool Pathfinder::refine(const Map& map, int fromX, int fromY, int toX, int toY,
+                        std::vector<std::pair<int, int>>& path) const {
+    int cluster = clusterOf(fromX, fromY);
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, x0, y0, x1, y1);
+    if (toX < x0 || toY < y0 || toX > x1 || toY > y1) return false;
+    int clusterWidth = x1 - x0 + 1;
+
+    localSearch(map, cluster, fromX, fromY);
+    int target = (toY - y0) * clusterWidth + (toX - x0);
+    if (localDist[target] == INT_MAX) return false;
+
+    size_t first = path.size();
+    for (int cell = target; localParent[cell] != -1; cell = localParent[cell]) {
+        path.emplace_back(x0 + cell % clusterWidth, y0 + cell / clusterWidth);
+    }
+    std::reverse(path.begin() + first, path.end());
+    return true;
+}
+
+// A* over the abstract graph with start and goal joined to the entrances
+// of their clusters; route receives the entrance nodes in walking order
+bool Pathfinder::abstractRoute(const Map& map, int fromX, int fromY, int toX, int toY,
+                               std::vector<int>& route) const {
+    route.clear();
+    int startCluster = clusterOf(fromX, fromY);
+    int goalCluster = clusterOf(toX, toY);
+
+    // stamps tell this search's entries from stale ones without clearing
+    if (searchStamp.size() < nodes.size()) {
+        searchStamp.resize(nodes.size(), 0);
+        goalStamp.resize(nodes.size(), 0);
+        bestCost.resize(nodes.size());
+        cameFrom.resize(nodes.size());
+        goalCost.resize(nodes.size());
+    }
+    ++searchId;
+
+    int gx0, gy0, gx1, gy1;
+    clusterBounds(goalCluster, gx0, gy0, gx1, gy1);
+    localSearch(map, goalCluster, toX, toY);
+    bool goalReachable = false;
+    for (int id : clusterNodes[goalCluster]) {
+        int d = localDist[(nodes[id].y - gy0) * (gx1 - gx0 + 1) + (nodes[id].x - gx0)];
+        if (d != INT_MAX) {
+            goalStamp[id] = searchId;
+            goalCost[id] = d;
+            goalReachable = true;
+        }
+    }
+    if (!goalReachable) return false;
+
+    const int START = -1, GOAL = -2;
+    using Entry = std::pair<int, int>;  // (f, node)
+    openList.clear();
+    int goalBest = INT_MAX, goalFrom = START;
+
+    auto push = [&](int f, int node) {
+        openList.push_back({f, node});
+        std::push_heap(openList.begin(), openList.end(), std::greater<Entry>());
+    };
+    auto relax = [&](int from, int to, int g) {
+        if (to == GOAL) {
+            if (g < goalBest) {
+                goalBest = g;
+                goalFrom = from;
+                push(g, GOAL);
+            }
+            return;
+        }
+        if (searchStamp[to] == searchId && bestCost[to] <= g) return;
+        searchStamp[to] = searchId;
+        bestCost[to] = g;
+        cameFrom[to] = from;
+        push(g + chebyshev(nodes[to].x, nodes[to].y, toX, toY), to);
+    };
+
+    int sx0, sy0, sx1, sy1;
+    clusterBounds(startCluster, sx0, sy0, sx1, sy1);
+    localSearch(map, startCluster, fromX, fromY);
+    for (int id : clusterNodes[startCluster]) {
+        int d = localDist[(nodes[id].y - sy0) * (sx1 - sx0 + 1) + (nodes[id].x - sx0)];
+        if (d != INT_MAX) relax(START, id, d);
+    }
+
+    bool found = false;
+    while (!openList.empty()) {
+        std::pop_heap(openList.begin(), openList.end(), std::greater<Entry>());
+        auto [f, current] = openList.back();
+        openList.pop_back();
+        if (current == GOAL) {
+            found = true;
+            break;
+        }
+        int g = bestCost[current];
+        if (f > g + chebyshev(nodes[current].x, nodes[current].y, toX, toY)) continue;
+
+        const Node& node = nodes[current];
+        for (const auto& edge : node.edges) {
+            relax(current, edge.to, g + edge.cost);
+        }
+        if (node.partner >= 0) {
+            relax(current, node.partner, g + 1);
+        }
+        if (goalStamp[current] == searchId) {
+            relax(current, GOAL, g + goalCost[current]);
+        }
+    }
+    if (!found) return false;
+
+    for (int id = goalFrom; id != START; id = cameFrom[id]) {
+        route.push_back(id);
+    }
+    std::reverse(route.begin(), route.end());
+    return true;
+}
+
+std::vector<std::pair<int, int>> Pathfinder::findPath(const Map& map, int fromX, int fromY, int toX, int toY) const {
+    std::vector<std::pair<int, int>> path = {{fromX, fromY}};
+    if (fromX < 0 || fromY < 0 || fromX >= width || fromY >= height ||
+        toX < 0 || toY < 0 || toX >= width || toY >= height) {
+        return {};
+    }
+    if (fromX == toX && fromY == toY) return path;
+
+    if (clusterOf(fromX, fromY) == clusterOf(toX, toY) && refine(map, fromX, fromY, toX, toY, path)) {
+        return path;
+    }
+    if (!abstractRoute(map, fromX, fromY, toX, toY, routeNodes)) return {};
+
+    int x = fromX, y = fromY;
+    for (int id : routeNodes) {
+        const Node& node = nodes[id];
+        if (clusterOf(x, y) == node.cluster) {
+            if (!refine(map, x, y, node.x, node.y, path)) return {};
+        } else {
+            path.emplace_back(node.x, node.y);
+        }
+        x = node.x;
+        y = node.y;
+    }
+    if (!refine(map, x, y, toX, toY, path)) return {};
+    return path;
+}
+
+// goal reachable inside its cluster from the last entrance of a route
+bool Pathfinder::reachesGoal(const Map& map, int node, int toX, int toY) const {
+    int cluster = clusterOf(toX, toY);
+    if (nodes[node].cluster != cluster) return false;
+    int x0, y0, x1, y1;
+    clusterBounds(cluster, x0, y0, x1, y1);
+    localSearch(map, cluster, toX, toY);
+    return localDist[(nodes[node].y - y0) * (x1 - x0 + 1) + (nodes[node].x - x0)] != INT_MAX;
+}
+
+// Only the first leg of the route is refined: up to route[waypoint], the
+// first entrance that is not the start tile itself, or up to the goal when
+// waypoint is route.size(). The rest of the path is never built.
+bool Pathfinder::firstStep(const Map& map, const std::vector<int>& route, int fromX, int fromY,
+                           int toX, int toY, int& dx, int& dy, std::size_t& waypoint) const {
+    int wayX = toX, wayY = toY;
+    for (waypoint = 0; waypoint < route.size(); ++waypoint) {
+        const Node& node = nodes[route[waypoint]];
+        if (node.x == fromX && node.y == fromY) continue;
+        wayX = node.x;
+        wayY = node.y;
+        break;
+    }
+    stepTiles.clear();
+    if (clusterOf(wayX, wayY) != clusterOf(fromX, fromY)) {
+        // the route leaves through an entrance at the start tile
+        if (chebyshev(fromX, fromY, wayX, wayY) != 1) return false;
+        stepTiles.emplace_back(wayX, wayY);
+    } else if (!refine(map, fromX, fromY, wayX, wayY, stepTiles)) {
+        return false;
+    }
+    dx = stepTiles[0].first - fromX;
+    dy = stepTiles[0].second - fromY;
+    return true;
+}
+
+Pathfinder::CachedRoute& Pathfinder::cachedRoute(int x, int y) const {
+    unsigned tile = static_cast<unsigned>(y) * static_cast<unsigned>(width) + static_cast<unsigned>(x);
+    return routeCache[(tile * 2654435761u >> 16) % ROUTE_CACHE_SIZE];
+}
+
+bool Pathfinder::nextStep(const Map& map, int fromX, int fromY, int toX, int toY, int& dx, int& dy) const {
+    if (fromX < 0 || fromY < 0 || fromX >= width || fromY >= height ||
+        toX < 0 || toY < 0 || toX >= width || toY >= height || (fromX == toX && fromY == toY)) {
+        return false;
+    }
+    int goalCluster = clusterOf(toX, toY);
+    if (clusterOf(fromX, fromY) == goalCluster) {
+        stepTiles.clear();
+        if (refine(map, fromX, fromY, toX, toY, stepTiles)) {
+            dx = stepTiles[0].first - fromX;
+            dy = stepTiles[0].second - fromY;
+            return true;
+        }
+    }
+
+    // The route left here by the previous step is followed while the goal
+    // stays reachable from its end; every step shortens it, so following it
+    // cannot loop. Otherwise the route is searched again.
+    std::vector<int>& route = routeNodes;
+    CachedRoute& cached = cachedRoute(fromX, fromY);
+    bool reuse = cached.x == fromX && cached.y == fromY && cached.goalCluster == goalCluster &&
+                 cached.version == version && reachesGoal(map, cached.nodes.back(), toX, toY);
+    cached.x = -1;
+    if (reuse) route.swap(cached.nodes);
+    std::size_t waypoint;
+    if (!reuse || !firstStep(map, route, fromX, fromY, toX, toY, dx, dy, waypoint)) {
+        if (!abstractRoute(map, fromX, fromY, toX, toY, route) ||
+            !firstStep(map, route, fromX, fromY, toX, toY, dx, dy, waypoint)) {
+            return false;
+        }
+    }
+
+    int nextX = fromX + dx, nextY = fromY + dy;
+    if (waypoint < route.size() && nodes[route[waypoint]].x == nextX && nodes[route[waypoint]].y == nextY) {
+        ++waypoint;
+    }
+    route.erase(route.begin(), route.begin() + waypoint);
+    if (!route.empty()) {
+        CachedRoute& next = cachedRoute(nextX, nextY);
+        next.x = nextX;
+        next.y = nextY;
+        next.goalCluster = goalCluster;
+        next.version = version;
+        next.nodes.swap(route);
+    }
+    return true;
+}
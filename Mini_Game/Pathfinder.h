@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+class Map;
+
+// Hierarchical pathfinder (HPA*): the grid is split into square clusters,
+// entrances between neighbouring clusters become nodes of an abstract graph
+// and queries search that graph instead of the whole map.
+class Pathfinder {
+private:
+    struct Edge {
+        int to;
+        int cost;
+    };
+
+    // rest of the abstract route of an earlier nextStep(), kept for the
+    // tile that step led to
+    struct CachedRoute {
+        int x = -1, y = -1;
+        int goalCluster = -1;
+        unsigned version = 0;
+        std::vector<int> nodes;
+    };
+
+    static const int ROUTE_CACHE_SIZE = 256;
+
+    struct Node {
+        int x, y;
+        int cluster;
+        int partner;                // node on the other side of the entrance
+        std::vector<Edge> edges;    // intra-cluster edges
+        bool alive;
+    };
+
+    int clusterSize;
+    int width = 0, height = 0;
+    int clustersX = 0, clustersY = 0;
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<std::vector<int>> clusterNodes;
+    unsigned version = 0;       // bumped whenever nodes or edges change
+
+    // scratch space of the searches, kept between queries so that an enemy
+    // step allocates nothing; queries on one Pathfinder must not overlap
+    mutable std::vector<int> localDist, localParent, localQueue;
+    mutable std::vector<unsigned> searchStamp, goalStamp;
+    mutable std::vector<int> bestCost, cameFrom, goalCost;
+    mutable std::vector<std::pair<int, int>> openList;
+    mutable std::vector<int> routeNodes;
+    mutable std::vector<std::pair<int, int>> stepTiles;
+    mutable unsigned searchId = 0;
+    // an enemy picks its route up again on the tile it stepped to, so
+    // most turns of a chase skip the abstract search
+    mutable std::vector<CachedRoute> routeCache;
+
+public:
+    explicit Pathfinder(int clusterSize = 10);
+
+    void build(const Map& map);
+    void rebuildAround(const Map& map, int x, int y);
+    std::vector<std::pair<int, int>> findPath(const Map& map, int fromX, int fromY, int toX, int toY) const;
+    bool nextStep(const Map& map, int fromX, int fromY, int toX, int toY, int& dx, int& dy) const;
+
+private:
+    int clusterOf(int x, int y) const;
+    void clusterBounds(int cluster, int& x0, int& y0, int& x1, int& y1) const;
+    int addNode(int x, int y);
+    void removeNode(int id);
+    bool diagonalOnly(const Map& map, int ax, int ay, int bx, int by) const;
+    void connect(int ax, int ay, int bx, int by);
+    void buildBorder(const Map& map, int clusterA, int clusterB);
+    void buildCorner(const Map& map, int cluster);
+    void clearBorder(int clusterA, int clusterB);
+    void buildIntraEdges(const Map& map, int cluster);
+    void localSearch(const Map& map, int cluster, int startX, int startY) const;
+    bool refine(const Map& map, int fromX, int fromY, int toX, int toY,
+                std::vector<std::pair<int, int>>& path) const;
+    bool abstractRoute(const Map& map, int fromX, int fromY, int toX, int toY,
+                       std::vector<int>& route) const;
+    bool reachesGoal(const Map& map, int node, int toX, int toY) const;
+    bool firstStep(const Map& map, const std::vector<int>& route, int fromX, int fromY,
+                   int toX, int toY, int& dx, int& dy, std::size_t& waypoint) const;
+    CachedRoute& cachedRoute(int x, int y) const;
+};
@@ -0,0 +1,120 @@
+// Times the hierarchical pathfinder on a large generated map:
+//   ./bench [width] [height] [wall percent] [cluster size]
+// defaults to a 10000 x 10000 map (10^8 tiles) with 30 % walls.
+#include "Map.h"
+#include "Pathfinder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double microseconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+void report(const char* what, std::vector<double>& samples) {
+    if (samples.empty()) {
+        std::printf("%-28s no samples\n", what);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) sum += sample;
+    std::printf("%-28s n=%-6zu mean %10.1f us  median %10.1f us  p99 %10.1f us\n", what, samples.size(),
+                sum / samples.size(), samples[samples.size() / 2], samples[samples.size() * 99 / 100]);
+}
+
+// a walkable tile about distance tiles away from (x, y) in both axes
+bool pickPair(const Map& map, std::mt19937& rng, int distance, int& fromX, int& fromY, int& toX, int& toY) {
+    int width = map.getWidth(), height = map.getHeight();
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        fromX = 1 + rng() % (width - 2);
+        fromY = 1 + rng() % (height - 2);
+        toX = fromX + static_cast<int>(rng() % (2 * distance + 1)) - distance;
+        toY = fromY + static_cast<int>(rng() % (2 * distance + 1)) - distance;
+        if (map.isWalkable(fromX, fromY) && map.isWalkable(toX, toY)) return true;
+    }
+    return false;
+}
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int height = argc > 2 ? std::atoi(argv[2]) : 10000;
+    int wallPercent = argc > 3 ? std::atoi(argv[3]) : 30;
+    int clusterSize = argc > 4 ? std::atoi(argv[4]) : 10;
+
+    // the map's own pathfinder is never built, so setWall() only marks tiles
+    std::mt19937 rng(42);
+    Map map(width, height);
+    for (int y = 1; y < height - 1; ++y) {
+        for (int x = 1; x < width - 1; ++x) {
+            if (static_cast<int>(rng() % 100) < wallPercent) map.setWall(x, y, true);
+        }
+    }
+
+    Pathfinder pathfinder(clusterSize);
+    auto start = Clock::now();
+    pathfinder.build(map);
+    std::printf("map %d x %d, %d %% walls, clusters of %d: build %.2f s\n", width, height, wallPercent, clusterSize,
+                microseconds(start, Clock::now()) / 1e6);
+
+    for (int distance : {5, 50, 500, 5000}) {
+        if (2 * distance > std::min(width, height)) continue;
+        int queries = distance >= 5000 ? 20 : distance >= 500 ? 200 : 2000;
+        std::vector<double> paths, steps;
+        for (int i = 0; i < queries; ++i) {
+            int fromX, fromY, toX, toY, dx, dy;
+            if (!pickPair(map, rng, distance, fromX, fromY, toX, toY)) continue;
+            auto begin = Clock::now();
+            pathfinder.findPath(map, fromX, fromY, toX, toY);
+            auto middle = Clock::now();
+            pathfinder.nextStep(map, fromX, fromY, toX, toY, dx, dy);
+            auto end = Clock::now();
+            paths.push_back(microseconds(begin, middle));
+            steps.push_back(microseconds(middle, end));
+        }
+        char label[64];
+        std::snprintf(label, sizeof(label), "findPath, distance %d", distance);
+        report(label, paths);
+        std::snprintf(label, sizeof(label), "nextStep, distance %d", distance);
+        report(label, steps);
+    }
+
+    // an enemy chasing a target turn by turn, as Map::updateEnemies() does
+    for (int distance : {50, 500}) {
+        if (2 * distance > std::min(width, height)) continue;
+        std::vector<double> turns;
+        for (int i = 0; i < 20; ++i) {
+            int fromX, fromY, toX, toY, dx, dy;
+            if (!pickPair(map, rng, distance, fromX, fromY, toX, toY)) continue;
+            for (int turn = 0; turn < 8 * distance && (fromX != toX || fromY != toY); ++turn) {
+                auto begin = Clock::now();
+                bool moved = pathfinder.nextStep(map, fromX, fromY, toX, toY, dx, dy);
+                turns.push_back(microseconds(begin, Clock::now()));
+                if (!moved) break;
+                fromX += dx;
+                fromY += dy;
+            }
+        }
+        char label[64];
+        std::snprintf(label, sizeof(label), "chase turn, distance %d", distance);
+        report(label, turns);
+    }
+
+    std::vector<double> rebuilds;
+    for (int i = 0; i < 2000; ++i) {
+        int x = 1 + rng() % (width - 2), y = 1 + rng() % (height - 2);
+        map.setWall(x, y, map.isWalkable(x, y));
+        auto begin = Clock::now();
+        pathfinder.rebuildAround(map, x, y);
+        rebuilds.push_back(microseconds(begin, Clock::now()));
+    }
+    report("rebuildAround", rebuilds);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+enum class TriggerType {
+    Exit,
+    Teleport,
+    Trap
+};
+
+struct Trigger {
+    int x, y;
+    TriggerType type;
+    int targetX = 0, targetY = 0;   // teleport destination
+    int value = 0;                  // trap damage
+};